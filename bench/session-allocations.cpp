@@ -0,0 +1,202 @@
+// Counts the heap allocations made by the transport in steady state: sending
+// packets whose payload is encoded already, as pushed events and shared
+// snapshots are, through a session, and handing packets over through the
+// lock-free queues. Building and parsing json DOMs is left out, as it always
+// allocates.
+//
+// Packets are sent in bursts, as the simulation thread does each tick. The
+// flush posted by the first packet of a burst allocates, since asio only
+// recycles the memory of handlers posted from a thread running an
+// `io_context`, so bursts of two sizes are sent to tell that fixed cost from
+// the cost per packet.
+//
+// Usage: bench-session-allocations [bursts]
+//
+// Exits with failure if anything allocates per packet.
+
+#include "codec.h"
+#include "event.h"
+#include "frame.h"
+#include "lock-free-queue.h"
+#include "packet.h"
+#include "session.h"
+#include <array>
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+
+namespace {
+
+std::atomic<std::size_t> allocations;
+
+auto count_allocation(std::size_t size, std::size_t alignment) -> void *
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  size = (std::max<std::size_t>(size, 1) + alignment - 1) / alignment *
+         alignment;
+  if (auto *const pointer{std::aligned_alloc(alignment, size)}) {
+    return pointer;
+  }
+  throw std::bad_alloc{};
+}
+
+} // namespace
+
+auto operator new(std::size_t size) -> void *
+{
+  return count_allocation(size, alignof(std::max_align_t));
+}
+
+auto operator new(std::size_t size, std::align_val_t alignment) -> void *
+{
+  return count_allocation(
+      size, std::max(static_cast<std::size_t>(alignment), sizeof(void *)));
+}
+
+void operator delete(void *pointer) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t /*size*/) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t /*alignment*/) noexcept
+{
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t /*size*/,
+                     std::align_val_t /*alignment*/) noexcept
+{
+  std::free(pointer);
+}
+
+auto main(int argc, char **argv) -> int
+{
+  using asio::ip::tcp;
+
+  spdlog::set_level(spdlog::level::warn);
+  std::size_t const bursts{argc > 1 ? std::stoul(argv[1]) : 1000};
+  // Both well below the limits of the session.
+  constexpr std::size_t small_burst{16};
+  constexpr std::size_t large_burst{256};
+
+  // The session is run by this thread between bursts, so that a burst is
+  // flushed at once.
+  asio::io_context io_context;
+  tcp::acceptor acceptor{io_context, {asio::ip::address_v4::loopback(), 0}};
+  tcp::socket peer{io_context};
+  peer.connect(acceptor.local_endpoint());
+  auto const session{std::make_shared<Session>(
+      acceptor.accept(),
+      frame::Handshake{.framing = frame::Framing::length_prefixed,
+                       .encoding = codec::Encoding::cbor})};
+  // Keeps `poll` working once the session is idle.
+  auto const work{asio::make_work_guard(io_context)};
+
+  // Reads and drops everything sent.
+  std::atomic<std::size_t> received;
+  std::thread reader{[&peer, &received] {
+    std::array<char, 64 * 1024> buffer;
+    try {
+      while (true) {
+        received.fetch_add(peer.read_some(asio::buffer(buffer)),
+                           std::memory_order_release);
+      }
+    }
+    catch (std::exception const &) {
+      // Closed by the end of the benchmark.
+    }
+  }};
+
+  Event event{"health-drop"};
+  event.set_param("player", "someone");
+  event.set_param("drop", 42);
+  auto bytes{std::make_shared<std::string>()};
+  codec::encode_to(std::move(event).data(), codec::Encoding::cbor, *bytes);
+  std::shared_ptr<std::string const> const payload{std::move(bytes)};
+
+  auto const send{[&session, &payload](std::size_t count) {
+    for (std::size_t i{}; i != count; ++i) {
+      Packet packet;
+      packet.encoded_payload = payload;
+      session->send(std::move(packet));
+    }
+  }};
+
+  // Every packet has the same size, found by sending one.
+  send(1);
+  while (received.load(std::memory_order_acquire) == 0) {
+    io_context.poll();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds{100});
+  auto const packet_size{received.load(std::memory_order_acquire)};
+  auto expected{packet_size};
+
+  // Sends `count` bursts of `size` packets, waiting for the peer to receive
+  // each one before the next.
+  //
+  // @return
+  //  The number of allocations made.
+  auto const send_bursts{[&](std::size_t count, std::size_t size) {
+    auto const start{allocations.load()};
+    for (std::size_t i{}; i != count; ++i) {
+      send(size);
+      expected += size * packet_size;
+      while (received.load(std::memory_order_acquire) < expected) {
+        io_context.poll();
+      }
+    }
+    return allocations.load() - start;
+  }};
+
+  // Warms the pools and caches up.
+  std::ignore = send_bursts(bursts / 10 + 1, large_burst);
+
+  auto const small_allocations{send_bursts(bursts, small_burst)};
+  auto const large_allocations{send_bursts(bursts, large_burst)};
+
+  Mpsc_queue<Packet> queue;
+  auto const hand_over{[&queue, &payload](std::size_t count) {
+    for (std::size_t i{}; i != count; ++i) {
+      Packet packet;
+      packet.encoded_payload = payload;
+      queue.push(std::move(packet));
+      std::ignore = queue.try_pop();
+    }
+  }};
+  hand_over(large_burst);
+  auto const queue_start{allocations.load()};
+  hand_over(bursts * large_burst);
+  auto const queue_allocations{allocations.load() - queue_start};
+
+  peer.shutdown(tcp::socket::shutdown_both);
+  reader.join();
+
+  // Bursts of both sizes cost the same, but for the packets.
+  auto const per_burst{static_cast<double>(small_allocations) /
+                       static_cast<double>(bursts)};
+  auto const per_packet{
+      (static_cast<double>(large_allocations) -
+       static_cast<double>(small_allocations)) /
+      static_cast<double>(bursts * (large_burst - small_burst))};
+  spdlog::warn("Session send: {:.3f} allocations per burst, {:.3f} per "
+               "packet.",
+               per_burst, per_packet);
+  spdlog::warn("Mpsc queue: {:.3f} allocations per packet.",
+               static_cast<double>(queue_allocations) /
+                   static_cast<double>(bursts * large_burst));
+
+  return large_allocations <= small_allocations && queue_allocations == 0
+             ? EXIT_SUCCESS
+             : EXIT_FAILURE;
+}
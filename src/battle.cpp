@@ -1,9 +1,11 @@
 #include "battle.h"
 #include "chrono.h"
 
-Battle::Battle(std::uint64_t id, std::array<Player *, 2> players,
+Battle::Battle(std::uint64_t id, std::array<Player_handle, 2> players,
+               Player_registry const *registry,
                Session_service *session_service)
-    : _id{id}, _players{players}, _session_service{session_service}
+    : _id{id}, _players{players}, _registry{registry},
+      _session_service{session_service}
 {
 }
 
@@ -19,18 +21,27 @@ void Battle::update(Duration delta)
   }
   _time_since_last_update = 0s;
 
-  if (std::ranges::all_of(_players,
-                          [](auto &player) { return player->health() != 0; })) {
-    auto const &attacker{_players.at(_turn % 2)};
-    auto &target{_players.at((_turn % 2) ^ 1)};
+  auto *const attacker{_registry->get(_players.at(_turn % 2))};
+  auto *const target{_registry->get(_players.at((_turn % 2) ^ 1))};
+  // A player is only removed after its battles are stopped, but be safe.
+  if (attacker == nullptr || target == nullptr) {
+    _ended = true;
+    return;
+  }
 
+  if (attacker->health() != 0 && target->health() != 0) {
     auto const drop{attacker->attack(*target)};
 
     Event health_drop{"health-drop"};
+    health_drop.set_param("game-id", _id);
     health_drop.set_param("player", target->name());
     health_drop.set_param("drop", drop);
-    _session_service->push_event(attacker->name(), health_drop);
-    _session_service->push_event(target->name(), health_drop);
+    // Number of attacks the event stands for, as consecutive drops of the same
+    // player may be merged into one.
+    health_drop.set_param("rounds", 1);
+    _session_service->push_event(_players.at(_turn % 2), health_drop);
+    _session_service->push_event(_players.at((_turn % 2) ^ 1),
+                                 std::move(health_drop));
 
     ++_turn;
   }
@@ -49,24 +60,35 @@ auto Battle::ended() const -> bool
   return _ended;
 }
 
-void Battle::stop(Stop_cause cause)
+auto Battle::involves(Player_handle player) const -> bool
+{
+  return std::ranges::find(_players, player) != _players.end();
+}
+
+void Battle::stop(Stop_cause cause, std::optional<Player_handle> escaper)
 {
   switch (cause) {
   case Stop_cause::normal: {
     Event game_end{"game-end"};
-    _session_service->push_event(_players[0]->name(), game_end);
+    _session_service->push_event(_players[0], game_end);
 
+    auto const *const loser{_registry->get(_players[0])};
     Event message{"message"};
-    message.add_arg(std::format("{} lost.", _players[0]->health() == 0
-                                                ? _players[0]->name() + " has"
+    message.add_arg(std::format("{} lost.", loser != nullptr &&
+                                                    loser->health() == 0
+                                                ? loser->name() + " has"
                                                 : "You have"));
-    _session_service->push_event(_players[1]->name(), message);
+    _session_service->push_event(_players[1], message);
     break;
   }
   case Stop_cause::escaping: {
     Event message{"message"};
     message.add_arg("Your opponent has escaped from the battle.");
-    _session_service->push_event(_players[1]->name(), message);
+    for (auto const player : _players) {
+      if (player != escaper) {
+        _session_service->push_event(player, message);
+      }
+    }
     break;
   }
   }
@@ -3,28 +3,35 @@
 #include "battle-fwd.h"
 #include "chrono.h"
 #include "player.h"
+#include "server/player-registry.h"
 #include "server/session-service.h"
 #include <algorithm>
+#include <optional>
 #include <queue>
 
 enum class Stop_cause : std::uint8_t { normal, escaping };
 
 class Battle {
 public:
-  Battle(std::uint64_t id, std::array<Player *, 2> players,
-         Session_service *session_service);
+  Battle(std::uint64_t id, std::array<Player_handle, 2> players,
+         Player_registry const *registry, Session_service *session_service);
 
   void update(Duration delta);
 
-  void stop(Stop_cause cause);
+  // Ends the battle. `escaper` is the player who escaped from it, and must be
+  // set if `cause` is `Stop_cause::escaping`.
+  void stop(Stop_cause cause, std::optional<Player_handle> escaper = {});
 
   [[nodiscard]] auto id() const -> std::uint64_t;
 
   [[nodiscard]] auto ended() const -> bool;
 
+  [[nodiscard]] auto involves(Player_handle player) const -> bool;
+
 private:
   std::size_t _id;
-  std::array<Player *, 2> _players; // First sender, second receiver
+  std::array<Player_handle, 2> _players; // First sender, second receiver
+  Player_registry const *_registry;
   Session_service *_session_service;
   bool _ended{};
   int _turn{};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "json.h"
+#include "reflect.h"
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Encodes values straight into a flat byte buffer, and decodes them back,
+// without building a json DOM. Fields of reflected types are walked at compile
+// time, and contiguous numbers are copied at once.
+//
+// Numbers are stored in the native byte order, and sizes as 32-bit integers.
+//
+// An enum read by the codec declares `last_enumerator(E)`, found by ADL, and
+// numbers its enumerators from 0 without gaps, so that values out of its range
+// are rejected.
+namespace binary_codec {
+
+static_assert(std::endian::native == std::endian::little,
+              "The binary codec assumes little-endian peers.");
+
+using Bytes = std::vector<std::uint8_t>;
+
+namespace detail {
+
+template <typename T> struct Is_vector : std::false_type {};
+template <typename T, typename A>
+struct Is_vector<std::vector<T, A>> : std::true_type {};
+
+template <typename T> struct Is_array : std::false_type {};
+template <typename T, std::size_t n>
+struct Is_array<std::array<T, n>> : std::true_type {};
+
+template <typename T> struct Is_pair : std::false_type {};
+template <typename T, typename U>
+struct Is_pair<std::pair<T, U>> : std::true_type {};
+
+template <typename T> struct Is_map : std::false_type {};
+template <typename K, typename V, typename C, typename A>
+struct Is_map<std::map<K, V, C, A>> : std::true_type {};
+
+template <typename T> struct Is_optional : std::false_type {};
+template <typename T> struct Is_optional<std::optional<T>> : std::true_type {};
+
+// Numbers that can be copied as a contiguous block.
+template <typename T>
+concept Trivial_number =
+    (std::is_arithmetic_v<T> || std::is_enum_v<T>) && !std::same_as<T, bool>;
+
+// Numbers that can be read as a contiguous block, as any bytes make a valid
+// value of them.
+template <typename T>
+concept Unchecked_number = Trivial_number<T> && !std::is_enum_v<T>;
+
+} // namespace detail
+
+class Writer {
+public:
+  explicit Writer(Bytes &out) : _out{&out} {}
+
+  template <typename T> void write(T const &value)
+  {
+    if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+      write_raw(&value, sizeof(value));
+    }
+    else if constexpr (std::same_as<T, std::string>) {
+      write_size(value.size());
+      write_raw(value.data(), value.size());
+    }
+    else if constexpr (detail::Is_vector<T>::value) {
+      write_size(value.size());
+      if constexpr (detail::Trivial_number<typename T::value_type>) {
+        write_raw(value.data(), value.size() * sizeof(typename T::value_type));
+      }
+      else {
+        for (auto const &element : value) {
+          write(element);
+        }
+      }
+    }
+    else if constexpr (detail::Is_array<T>::value) {
+      for (auto const &element : value) {
+        write(element);
+      }
+    }
+    else if constexpr (detail::Is_pair<T>::value) {
+      write(value.first);
+      write(value.second);
+    }
+    else if constexpr (detail::Is_map<T>::value) {
+      write_size(value.size());
+      for (auto const &[key, mapped] : value) {
+        write(key);
+        write(mapped);
+      }
+    }
+    else if constexpr (detail::Is_optional<T>::value) {
+      write(value.has_value());
+      if (value) {
+        write(*value);
+      }
+    }
+    else if constexpr (std::same_as<T, json>) {
+      // Values without a fixed shape fall back to CBOR.
+      auto const size_offset{_out->size()};
+      write_size(0);
+      cbor_to(value, *_out);
+      auto const size{
+          static_cast<std::uint32_t>(_out->size() - size_offset - 4)};
+      std::memcpy(_out->data() + size_offset, &size, sizeof(size));
+    }
+    else if constexpr (Reflected<T>) {
+      reflect_fields(value, [this](std::string_view /*name*/,
+                                   auto const &field) { write(field); });
+    }
+    else {
+      // Any other range is written like a vector, so that views can be
+      // written without copying their elements into one.
+      static_assert(std::ranges::sized_range<T const>,
+                    "Type is not supported by binary codec.");
+      write_size(std::ranges::size(value));
+      for (auto const &element : value) {
+        write(element);
+      }
+    }
+  }
+
+private:
+  void write_size(std::size_t size)
+  {
+    write(static_cast<std::uint32_t>(size));
+  }
+
+  void write_raw(void const *data, std::size_t size)
+  {
+    auto const *const bytes{static_cast<std::uint8_t const *>(data)};
+    _out->insert(_out->end(), bytes, bytes + size);
+  }
+
+  Bytes *_out;
+};
+
+// Throws `std::runtime_error` if the input is truncated, or holds a bool or an
+// enum out of its range.
+class Reader {
+public:
+  explicit Reader(std::span<std::uint8_t const> in) : _in{in} {}
+
+  template <typename T> void read(T &value)
+  {
+    if constexpr (std::same_as<T, bool>) {
+      // Any byte but 0 and 1 would be undefined behavior as a bool.
+      std::uint8_t byte{};
+      read_raw(&byte, sizeof(byte));
+      if (byte > 1) {
+        throw std::runtime_error{"Malformed binary value: bool out of range"};
+      }
+      value = byte == 1;
+    }
+    else if constexpr (std::is_enum_v<T>) {
+      std::underlying_type_t<T> underlying{};
+      read_raw(&underlying, sizeof(underlying));
+      if (std::cmp_less(underlying, 0) ||
+          std::cmp_greater(underlying,
+                           std::to_underlying(last_enumerator(T{})))) {
+        throw std::runtime_error{"Malformed binary value: enum out of range"};
+      }
+      value = static_cast<T>(underlying);
+    }
+    else if constexpr (std::is_arithmetic_v<T>) {
+      read_raw(&value, sizeof(value));
+    }
+    else if constexpr (std::same_as<T, std::string>) {
+      value.resize(read_size());
+      read_raw(value.data(), value.size());
+    }
+    else if constexpr (detail::Is_vector<T>::value) {
+      value.resize(read_size());
+      if constexpr (detail::Unchecked_number<typename T::value_type>) {
+        read_raw(value.data(), value.size() * sizeof(typename T::value_type));
+      }
+      else {
+        for (auto &element : value) {
+          read(element);
+        }
+      }
+    }
+    else if constexpr (detail::Is_array<T>::value) {
+      for (auto &element : value) {
+        read(element);
+      }
+    }
+    else if constexpr (detail::Is_pair<T>::value) {
+      read(value.first);
+      read(value.second);
+    }
+    else if constexpr (detail::Is_map<T>::value) {
+      value.clear();
+      for (auto size{read_size()}; size != 0; --size) {
+        typename T::key_type key{};
+        read(key);
+        read(value[std::move(key)]);
+      }
+    }
+    else if constexpr (detail::Is_optional<T>::value) {
+      bool has_value{};
+      read(has_value);
+      if (has_value) {
+        read(value.emplace());
+      }
+      else {
+        value.reset();
+      }
+    }
+    else if constexpr (std::same_as<T, json>) {
+      auto const size{read_size()};
+      value = json::from_cbor(_in.begin(), _in.begin() + size);
+      _in = _in.subspan(size);
+    }
+    else {
+      static_assert(Reflected<T>, "Type is not supported by binary codec.");
+      reflect_fields(value, [this](std::string_view /*name*/, auto &field) {
+        read(field);
+      });
+    }
+  }
+
+  // Whether everything has been read.
+  [[nodiscard]] auto empty() const -> bool
+  {
+    return _in.empty();
+  }
+
+private:
+  // Sizes can't exceed the remaining input, since every element takes at least
+  // one byte. This rejects malformed sizes before allocating for them.
+  auto read_size() -> std::size_t
+  {
+    std::uint32_t size{};
+    read(size);
+    if (size > _in.size()) {
+      throw std::runtime_error{"Malformed binary value: size too large"};
+    }
+    return size;
+  }
+
+  void read_raw(void *data, std::size_t size)
+  {
+    if (size > _in.size()) {
+      throw std::runtime_error{"Malformed binary value: truncated"};
+    }
+    std::memcpy(data, _in.data(), size);
+    _in = _in.subspan(size);
+  }
+
+  std::span<std::uint8_t const> _in;
+};
+
+// Appends the encoded `value` to `out`.
+template <typename T> void encode_to(T const &value, Bytes &out)
+{
+  Writer{out}.write(value);
+}
+
+// Bytes left after the value are rejected, so that input of another type, or
+// cut short in a way that still decodes, fails instead of half-decoding.
+template <typename T>
+[[nodiscard]] auto decode(std::span<std::uint8_t const> bytes) -> T
+{
+  T value{};
+  Reader reader{bytes};
+  reader.read(value);
+  if (!reader.empty()) {
+    throw std::runtime_error{"Malformed binary value: trailing bytes"};
+  }
+  return value;
+}
+
+} // namespace binary_codec
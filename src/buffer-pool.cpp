@@ -0,0 +1,54 @@
+#include "buffer-pool.h"
+
+auto Buffer_pool::instance() -> Buffer_pool &
+{
+  static Buffer_pool pool;
+  return pool;
+}
+
+auto Buffer_pool::acquire(std::size_t size) -> std::string
+{
+  for (std::size_t i{}; i != class_count; ++i) {
+    if (size > class_size(i)) {
+      continue;
+    }
+    auto &size_class{_classes[i]};
+    {
+      std::lock_guard lock{size_class.mutex};
+      if (!size_class.free.empty()) {
+        auto buffer{std::move(size_class.free.back())};
+        size_class.free.pop_back();
+        return buffer;
+      }
+    }
+    std::string buffer;
+    buffer.reserve(class_size(i));
+    return buffer;
+  }
+
+  // Larger than any class, which is rare enough not to be pooled.
+  std::string buffer;
+  buffer.reserve(size);
+  return buffer;
+}
+
+void Buffer_pool::release(std::string buffer)
+{
+  // Filed under the largest class it can serve. Buffers much larger than any
+  // class would keep too much memory for it, and are freed.
+  auto const capacity{buffer.capacity()};
+  if (capacity < min_class_size || capacity >= class_size(class_count)) {
+    return;
+  }
+  std::size_t i{};
+  while (i + 1 != class_count && class_size(i + 1) <= capacity) {
+    ++i;
+  }
+
+  auto &size_class{_classes[i]};
+  std::lock_guard lock{size_class.mutex};
+  if (size_class.free.size() < max_free_bytes_per_class / class_size(i)) {
+    buffer.clear();
+    size_class.free.push_back(std::move(buffer));
+  }
+}
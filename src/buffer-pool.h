@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Buffers of a few size classes shared by every session, so that a session
+// doesn't keep a buffer sized to its largest message for its whole life.
+// Buffers are taken when there is something to read or write, and given back
+// once it's done. Can be used from any thread.
+class Buffer_pool {
+public:
+  // Sizes of the classes, each 4 times the previous one.
+  static constexpr std::size_t min_class_size{std::size_t{4} << 10};
+  static constexpr std::size_t class_count{5};
+  // At most this many bytes of free buffers are kept for each class.
+  static constexpr std::size_t max_free_bytes_per_class{std::size_t{4} << 20};
+
+  static auto instance() -> Buffer_pool &;
+
+  // @return
+  //  An empty buffer with room for at least `size` bytes.
+  [[nodiscard]] auto acquire(std::size_t size) -> std::string;
+
+  // Keeps `buffer` for later use, unless enough buffers of its size are kept
+  // already.
+  void release(std::string buffer);
+
+private:
+  struct Size_class {
+    std::mutex mutex;
+    std::vector<std::string> free;
+  };
+
+  [[nodiscard]] static constexpr auto class_size(std::size_t index)
+      -> std::size_t
+  {
+    return min_class_size << (2 * index);
+  }
+
+  std::array<Size_class, class_count> _classes;
+};
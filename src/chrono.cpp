@@ -0,0 +1,37 @@
+#include "chrono.h"
+#include <atomic>
+#include <format>
+
+namespace {
+
+// `0` until the first tick.
+std::atomic<Timestamp> cached_now;
+
+auto system_now() -> Timestamp
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+void coarse_clock::tick()
+{
+  cached_now.store(system_now(), std::memory_order_relaxed);
+}
+
+auto coarse_clock::now() -> Timestamp
+{
+  auto const now{cached_now.load(std::memory_order_relaxed)};
+  return now != 0 ? now : system_now();
+}
+
+auto format_local_time(Timestamp timestamp) -> std::string
+{
+  std::chrono::sys_seconds const time{
+      std::chrono::round<std::chrono::seconds>(
+          std::chrono::milliseconds{timestamp})};
+  std::chrono::zoned_time const local{std::chrono::current_zone(), time};
+  return std::format("{:%F %T}", local.get_local_time());
+}
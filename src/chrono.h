@@ -1,5 +1,24 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+#include <string>
 
 using Duration = std::chrono::nanoseconds;
+
+// Milliseconds since the Unix epoch, by the system clock.
+using Timestamp = std::int64_t;
+
+// The clock stamping commands and events. Reading it is cheap, as the time is
+// taken once per tick by `tick()`. Until the first tick, the system clock is
+// read on each call.
+namespace coarse_clock {
+
+void tick();
+[[nodiscard]] auto now() -> Timestamp;
+
+} // namespace coarse_clock
+
+// Formats `timestamp` in the local time zone, as "2024-01-31 12:34:56". This
+// looks the time zone up, so call it only for display.
+[[nodiscard]] auto format_local_time(Timestamp timestamp) -> std::string;
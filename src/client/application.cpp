@@ -1,4 +1,5 @@
 #include "application.h"
+#include "delta.h"
 #include "event.h"
 #include "handle-error.h"
 #include "imgui.h"
@@ -68,11 +69,22 @@ void Application::update()
   _frame_per_second = 1.0s / (now - last_tick);
   last_tick = now;
 
-  // Async query event would be started before main loop.
+  // Events are pushed by the server since logging in.
+
+  if (_udp && now - _last_move_sent >= move_resend_interval) {
+    _udp->send_move(_move_direction);
+    _last_move_sent = now;
+  }
 
   if (_you) {
+    // Replies carry the fields changed since the previous reply, and arrive in
+    // order.
     async_request(Command{"sync"}, [this](Event const &e) {
-      _you = std::make_unique<Player>(e.get_arg<Player>(0));
+      if (e.name() != "ok" || !_you) {
+        return;
+      }
+      delta::fields_from_json(*_you, e.get_param<delta::Field_mask>("mask"),
+                              e.args());
     });
   }
 
@@ -81,19 +93,11 @@ void Application::update()
     async_request(Command{"list-store-items"}, [this](Event const &e) {
       _store_items = e.get_arg<std::map<std::string, item::Item_info>>(0);
     });
-    async_request(Command{"get-game-map"}, [this](Event const &e) {
-      _game_map = std::make_unique<Game_map>(e.get_arg<Game_map>(0));
-    });
+    sync_world();
     break;
   case State::starting_battle:
-    async_request(Command{"list-players"}, [this](Event const &e) {
-      if (e.name() != "ok") {
-        throw std::runtime_error{
-            "list-players returns {}, which is impossible."};
-      }
-      auto players{e.get_arg<std::vector<Player>>(0)};
-      update_players(players);
-    });
+    sync_world();
+    break;
   default:
     break;
   }
@@ -348,7 +352,7 @@ void Application::process_event(Event const &event)
     if (who == _you->name()) {
       _you->take_damage(drop);
     }
-    ++_battled_rounds;
+    _battled_rounds += event.get_param<std::size_t>("rounds");
   }
   else if (event.name() == "game-end") {
     add_to_show("Game ended.");
@@ -391,13 +395,141 @@ void Application::async_request(Command const &command,
                                 std::function<void(Event)> on_replied)
 {
   spdlog::debug("Scheduling request: {}", command.dump());
-  Packet packet{Packet::Sender{_name, _name}, command.dump()};
+  // Names are kept under JSON, which is meant to be read by people.
+  Packet packet{[this, &command] {
+    if (_session->encoding() == codec::Encoding::json) {
+      return json(command);
+    }
+    auto packed{command};
+    packed.use_opcode();
+    return json(packed);
+  }()};
+  // Once logged in, the session is bound to us, so the sender is omitted.
+  if (!_you) {
+    packet.sender = Packet::Sender{_name, _name};
+  }
   _session->schedule_request(
       std::move(packet), [on_replied{std::move(on_replied)}](Packet packet) {
-        on_replied(Event{json::parse(std::move(packet.payload))});
+        on_replied(Event{std::move(packet.payload)});
       });
 }
 
+void Application::move(Vec2 direction)
+{
+  _move_direction = direction;
+  if (_udp) {
+    _udp->send_move(direction);
+    _last_move_sent = current_time();
+    return;
+  }
+
+  Command move{"move"};
+  move.set_param("direction", direction);
+  async_request(move, [](Event const &e) {
+    if (e.name() != "ok") {
+      throw std::runtime_error{e.get_arg<std::string>(0)};
+    }
+  });
+}
+
+void Application::open_udp()
+{
+  async_request(Command{"open-udp"}, [this](Event const &e) {
+    if (e.name() != "ok") {
+      spdlog::warn("Server doesn't support datagrams, moving through the "
+                   "session instead.");
+      return;
+    }
+    auto const port{e.get_param<std::uint16_t>("port")};
+    auto const endpoints{udp::resolver{_io_context}.resolve(
+        udp::v4(), std::string_view{_host_buf.data()}, std::to_string(port))};
+    _udp = std::make_unique<Udp_client>(_io_context, *endpoints.begin(),
+                                        e.get_param<std::uint64_t>("token"),
+                                        udp_loss_rate);
+    _udp->receive_positions([this](datagram::Positions positions) {
+      for (auto const &[name, position] : positions.players) {
+        if (_you && name == _you->name()) {
+          _you->position(position);
+        }
+        else if (auto const it{_players.find(name)}; it != _players.end()) {
+          it->second->position(position);
+        }
+      }
+    });
+  });
+}
+
+void Application::sync_world()
+{
+  // A delta only applies to the world it's computed from, so the next request
+  // waits for the world to be updated by the previous reply.
+  if (_syncing_world) {
+    return;
+  }
+  _syncing_world = true;
+
+  Command sync{"sync-world"};
+  sync.set_param("baseline", _world_tick);
+  async_request(sync, [this](Event const &e) {
+    _syncing_world = false;
+    if (e.name() != "ok") {
+      spdlog::warn("Failed to sync the world: {}", e.dump());
+      return;
+    }
+    apply_world_delta(e);
+  });
+}
+
+void Application::apply_world_delta(Event const &e)
+{
+  if (e.get_param<std::uint64_t>("baseline") == 0) {
+    _players.clear();
+    auto const map{e.get_param<std::vector<std::vector<char>>>("map")};
+    _game_map = std::make_unique<Game_map>(map.size(),
+                                           map.empty() ? 0 : map[0].size());
+    for (std::size_t row{}; row != map.size(); ++row) {
+      for (std::size_t col{}; col != map[row].size(); ++col) {
+        _game_map->modify(row, col, Basic_terrain{map[row][col]});
+      }
+    }
+  }
+  else {
+    for (auto const &name :
+         e.get_param<std::vector<std::string>>("removed")) {
+      _players.erase(name);
+    }
+    for (auto const &cell : e.get_param<json>("cells")) {
+      _game_map->modify(cell[0].get<std::size_t>(),
+                        cell[1].get<std::size_t>(),
+                        Basic_terrain{cell[2].get<char>()});
+    }
+  }
+
+  for (auto const &change : e.get_param<json>("players")) {
+    auto &player{_players[change["name"].get<std::string>()]};
+    if (player == nullptr) {
+      player = std::make_unique<Player>();
+    }
+    delta::fields_from_json(*player, change["mask"].get<delta::Field_mask>(),
+                            change["fields"]);
+  }
+
+  _world_tick = e.get_param<std::uint64_t>("tick");
+}
+
+void Application::subscribe_events()
+{
+  _session->handle_pushes([this](Packet packet) {
+    process_event(Event{std::move(packet.payload)});
+  });
+  async_request(Command{"subscribe-events"}, [this](Event const &e) {
+    if (e.name() != "ok") {
+      spdlog::warn("Server doesn't push events, querying them instead.");
+      schedule_continuous_query_event();
+    }
+  });
+}
+
 void Application::schedule_continuous_query_event()
 {
   async_request(Command{"query-event"}, [this](Event const &event) {
@@ -450,7 +582,8 @@ void Application::render_unlogged_in()
           assert(false);
         }
         _you = std::make_unique<Player>(e.get_arg<Player>(0));
-        schedule_continuous_query_event();
+        subscribe_events();
+        open_udp();
         _state = State::greeting;
       });
       _state = State::logging;
@@ -517,15 +650,17 @@ void Application::render_messages()
 }
 void Application::connect_to_the_server()
 {
-  _session = std::make_shared<Session>(
-      connect(_io_context, std::string_view{_host_buf}, "1438"));
-}
-void Application::update_players(std::vector<Player> const &players)
-{
-  _players.clear();
-  for (auto &&p : players) {
-    _players.insert({p.name(), std::make_unique<Player>(p)});
-  }
+  auto socket{connect(_io_context, std::string_view{_host_buf}, "1438")};
+#ifdef NDEBUG
+  constexpr auto encoding{codec::Encoding::cbor};
+#else
+  // Keeps the traffic readable while debugging.
+  constexpr auto encoding{codec::Encoding::json};
+#endif
+  auto const handshake{negotiate_handshake(
+      socket, frame::Handshake{.framing = frame::Framing::length_prefixed,
+                               .encoding = encoding})};
+  _session = std::make_shared<Session>(std::move(socket), handshake);
 }
 Application::~Application() = default;
 auto Application::state() const -> State
@@ -2,6 +2,7 @@
 
 #include "client/main-window.h"
 #include "client/message.h"
+#include "client/udp-client.h"
 #include "command.h"
 #include "event.h"
 #include "game-map.h"
@@ -38,11 +39,23 @@ public:
   void async_request(Command const &command,
                      std::function<void(Event)> on_replied);
 
+  // Moves towards `direction`, through the datagram channel if it's open.
+  void move(Vec2 direction);
+
 private:
   // Relative time, since start of the program. Like `glfwGetTime()`.
   [[nodiscard]] auto current_time() const -> Duration;
 
   [[nodiscard]] auto should_stop() const -> bool;
+  // Asks the server to push events to us, falling back to querying them if
+  // the server doesn't support it.
+  void subscribe_events();
+  // Opens the datagram channel for movement, keeping the session for the
+  // rest.
+  void open_udp();
+  // Asks the server for the changes of the world since the last sync.
+  void sync_world();
+  void apply_world_delta(Event const &e);
   void schedule_continuous_query_event();
   void tick();
   void poll_events();
@@ -68,6 +81,13 @@ private:
 
   asio::io_context _io_context;
   Session_ptr _session;
+  std::unique_ptr<Udp_client> _udp;
+  // Raise it to test the datagram channel over loopback.
+  static constexpr float udp_loss_rate{};
+  // Moves are repeated at this interval, replacing lost datagrams.
+  static constexpr auto move_resend_interval{100ms};
+  Vec2 _move_direction{};
+  Duration _last_move_sent{};
 
   std::chrono::time_point<std::chrono::steady_clock> _start_time;
 
@@ -87,8 +107,10 @@ private:
 
   std::set<Message> _messages;
 
-  void update_players(std::vector<Player> const &players);
   std::map<std::string, std::unique_ptr<Player>> _players;
+  // The tick of the world known by us, `0` if none.
+  std::uint64_t _world_tick{};
+  bool _syncing_world{};
 
   std::map<std::string, item::Item_info> _store_items;
 
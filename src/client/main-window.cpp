@@ -24,23 +24,11 @@ void Main_window::key_callback(int key, int /*scancode*/, int action,
             {GLFW_KEY_A, Vec2{0, -1}},
             {GLFW_KEY_S, Vec2{1, 0}},
             {GLFW_KEY_D, Vec2{0, 1}}};
-        Command move{"move"};
-        move.set_param("direction", dirs.at(key));
-        _app->async_request(move, [](Event const &e) {
-          if (e.name() != "ok") {
-            throw std::runtime_error{e.get_arg<std::string>(0)};
-          }
-        });
+        _app->move(dirs.at(key));
         break;
       }
       case GLFW_RELEASE: {
-        Command move{"move"};
-        move.set_param("direction", Vec2{});
-        _app->async_request(move, [](Event const &e) {
-          if (e.name() != "ok") {
-            throw std::runtime_error{e.get_arg<std::string>(0)};
-          }
-        });
+        _app->move(Vec2{});
         break;
       }
       default:
@@ -0,0 +1,71 @@
+#include "udp-client.h"
+#include <spdlog/spdlog.h>
+
+Udp_client::Udp_client(asio::io_context &io_context, udp::endpoint server,
+                       std::uint64_t token, float loss_rate)
+    : _socket{io_context, udp::v4()}, _token{token}, _loss{loss_rate}
+{
+  _socket.connect(server);
+}
+
+void Udp_client::send_move(Vec2 direction)
+{
+  if (_loss.should_drop()) {
+    ++_last_sent;
+    return;
+  }
+  auto const bytes{std::make_shared<binary_codec::Bytes>(datagram::encode(
+      datagram::Header{.token = _token,
+                       .sequence = ++_last_sent,
+                       .type = datagram::Type::move},
+      datagram::Move{.direction = direction}))};
+  _socket.async_send(asio::buffer(*bytes),
+                     [bytes](std::error_code ec, std::size_t /*length*/) {
+                       if (ec) {
+                         spdlog::debug("Failed to send datagram: {}",
+                                       ec.message());
+                       }
+                     });
+}
+
+void Udp_client::receive_positions(
+    std::function<void(datagram::Positions)> on_positions)
+{
+  _on_positions = std::move(on_positions);
+  do_receive();
+}
+
+void Udp_client::do_receive()
+{
+  _socket.async_receive(
+      asio::buffer(_receive_buf), [this](std::error_code ec,
+                                         std::size_t length) {
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
+        if (ec) {
+          // Such as the server not listening yet. Datagrams are best effort.
+          spdlog::debug("Error occurred while receiving datagram: {}",
+                        ec.message());
+          do_receive();
+          return;
+        }
+
+        binary_codec::Reader reader{
+            std::span<std::uint8_t const>{_receive_buf.data(), length}};
+        auto const header{datagram::read_header(reader)};
+        if (!_loss.should_drop() && header && header->token == _token &&
+            header->type == datagram::Type::positions &&
+            _received.accept(header->sequence)) {
+          try {
+            datagram::Positions positions;
+            reader.read(positions);
+            _on_positions(std::move(positions));
+          }
+          catch (std::runtime_error const &e) {
+            spdlog::debug("Dropping malformed datagram: {}", e.what());
+          }
+        }
+        do_receive();
+      });
+}
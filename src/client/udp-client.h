@@ -0,0 +1,36 @@
+#pragma once
+
+#include "datagram.h"
+#include <array>
+#include <asio.hpp>
+#include <functional>
+
+using asio::ip::udp;
+
+// The client side of the datagram channel. Only movement goes through it.
+class Udp_client {
+public:
+  // @param token Given by the server on "open-udp".
+  // @param loss_rate Probability of dropping each datagram, in and out.
+  Udp_client(asio::io_context &io_context, udp::endpoint server,
+             std::uint64_t token, float loss_rate);
+
+  // Sends the current direction of movement. This should be repeated, since
+  // datagrams may be lost.
+  void send_move(Vec2 direction);
+
+  // Calls `on_positions` with each snapshot of positions newer than the ones
+  // before.
+  void receive_positions(std::function<void(datagram::Positions)> on_positions);
+
+private:
+  void do_receive();
+
+  udp::socket _socket;
+  std::uint64_t _token;
+  std::uint32_t _last_sent{};
+  datagram::Sequence_filter _received;
+  datagram::Loss_injector _loss;
+  std::array<std::uint8_t, datagram::max_size> _receive_buf{};
+  std::function<void(datagram::Positions)> _on_positions;
+};
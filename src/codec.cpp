@@ -0,0 +1,197 @@
+#include "codec.h"
+#include "json-writer.h"
+#include <bit>
+#include <cassert>
+
+namespace {
+
+// Appends the `size` lowest bytes of `value`, most significant first.
+void put_big_endian(std::uint64_t value, std::size_t size, std::string &out)
+{
+  for (auto shift{size * 8}; shift != 0;) {
+    shift -= 8;
+    out += static_cast<char>(value >> shift & 0xFF);
+  }
+}
+
+// Size in bytes of the smallest of the unsigned integers of 1, 2, 4 or 8 bytes
+// holding `n`.
+auto uint_size(std::uint64_t n) -> std::size_t
+{
+  return n <= 0xFF ? 1 : n <= 0xFFFF ? 2 : n <= 0xFFFF'FFFF ? 4 : 8;
+}
+
+// Appends the initial bytes of a CBOR item of major type `major`: an unsigned
+// integer (0) of value `n`, or a text string (3) or map (5) of size `n`.
+void put_cbor_head(std::uint8_t major, std::uint64_t n, std::string &out)
+{
+  auto const type{static_cast<std::uint8_t>(major << 5)};
+  if (n < 24) {
+    out += static_cast<char>(type | n);
+    return;
+  }
+  auto const size{uint_size(n)};
+  // 24 to 27 tell that 1, 2, 4 or 8 bytes follow.
+  out += static_cast<char>(type | (24 + std::countr_zero(size)));
+  put_big_endian(n, size, out);
+}
+
+void put_msgpack_uint(std::uint64_t n, std::string &out)
+{
+  if (n < 0x80) {
+    out += static_cast<char>(n);
+    return;
+  }
+  auto const size{uint_size(n)};
+  // 0xCC to 0xCF are uint 8 to uint 64.
+  out += static_cast<char>(0xCC + std::countr_zero(size));
+  put_big_endian(n, size, out);
+}
+
+void put_msgpack_string(std::string_view s, std::string &out)
+{
+  if (s.size() < 32) {
+    out += static_cast<char>(0xA0 | s.size());
+  }
+  else {
+    auto const size{uint_size(s.size())};
+    // 0xD9 to 0xDB are str 8 to str 32.
+    out += static_cast<char>(0xD9 + std::countr_zero(size));
+    put_big_endian(s.size(), size, out);
+  }
+  out += s;
+}
+
+} // namespace
+
+void codec::encode_to(json const &j, Encoding encoding, std::string &out)
+{
+  switch (encoding) {
+  case Encoding::json:
+    dump_to(j, out);
+    break;
+  case Encoding::cbor:
+    cbor_to(j, out);
+    break;
+  case Encoding::msgpack:
+    msgpack_to(j, out);
+    break;
+  }
+}
+
+auto codec::encode_head_to(json const &object, std::string_view key,
+                           Encoding encoding, std::string &out)
+    -> std::string_view
+{
+  assert(object.is_object() && object.size() < 15);
+
+  auto const start{out.size()};
+  encode_to(object, encoding, out);
+  switch (encoding) {
+  case Encoding::json:
+    out.pop_back(); // '}'
+    if (!object.empty()) {
+      out += ',';
+    }
+    dump_to(json(key), out);
+    out += ':';
+    return "}";
+  case Encoding::cbor:
+  case Encoding::msgpack:
+    // Small maps keep their size in the low bits of the first byte in both
+    // encodings, so one more member adds one to it.
+    ++out[start];
+    encode_to(json(key), encoding, out);
+    return {};
+  }
+  return {};
+}
+
+auto codec::encode_head_to(std::span<Member const> members,
+                           std::string_view key, Encoding encoding,
+                           std::string &out) -> std::string_view
+{
+  assert(members.size() < 15);
+
+  if (encoding == Encoding::json) {
+    Json_writer writer{out};
+    writer.begin_object();
+    for (auto const &[name, value] : members) {
+      writer.key(name);
+      std::visit([&writer](auto const &v) { writer.write(v); }, value);
+    }
+    writer.key(key);
+    return "}";
+  }
+
+  auto const cbor{encoding == Encoding::cbor};
+  auto const put_string{[cbor, &out](std::string_view s) {
+    if (cbor) {
+      put_cbor_head(3, s.size(), out);
+      out += s;
+    }
+    else {
+      put_msgpack_string(s, out);
+    }
+  }};
+  auto const put_uint{[cbor, &out](std::uint64_t n) {
+    if (cbor) {
+      put_cbor_head(0, n, out);
+    }
+    else {
+      put_msgpack_uint(n, out);
+    }
+  }};
+
+  auto const size{members.size() + 1};
+  out += static_cast<char>(cbor ? 0xA0 | size : 0x80 | size);
+  for (auto const &[name, value] : members) {
+    put_string(name);
+    if (auto const *const s{std::get_if<std::string_view>(&value)}) {
+      put_string(*s);
+    }
+    else {
+      put_uint(std::get<std::uint64_t>(value));
+    }
+  }
+  put_string(key);
+  return {};
+}
+
+auto codec::decode(std::string_view bytes, Encoding encoding) -> json
+{
+  switch (encoding) {
+  case Encoding::json:
+    return json::parse(bytes.begin(), bytes.end());
+  case Encoding::cbor:
+    return json::from_cbor(bytes.begin(), bytes.end());
+  case Encoding::msgpack:
+    return json::from_msgpack(bytes.begin(), bytes.end());
+  }
+  return json::parse(bytes.begin(), bytes.end());
+}
+
+auto codec::to_string(Encoding encoding) -> std::string_view
+{
+  switch (encoding) {
+  case Encoding::json:
+    return "json";
+  case Encoding::cbor:
+    return "cbor";
+  case Encoding::msgpack:
+    return "msgpack";
+  }
+  return "json";
+}
+
+auto codec::encoding_from_string(std::string_view name)
+    -> std::optional<Encoding>
+{
+  for (auto const encoding :
+       {Encoding::json, Encoding::cbor, Encoding::msgpack}) {
+    if (name == to_string(encoding)) {
+      return encoding;
+    }
+  }
+  return std::nullopt;
+}
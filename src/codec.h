@@ -0,0 +1,47 @@
+#pragma once
+
+#include "json.h"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+// How json values are turned into bytes on the wire.
+namespace codec {
+
+enum class Encoding : std::uint8_t {
+  // Text, readable while debugging.
+  json,
+  // Binary encodings supported by nlohmann::json. They can only be used with
+  // length-prefixed framing, since they may contain '\n'.
+  cbor,
+  msgpack,
+};
+
+// Appends the encoded `j` to `out`.
+void encode_to(json const &j, Encoding encoding, std::string &out);
+// Appends `object` with one more member named `key` to `out`, but leaves out
+// the value of that member, so that a value encoded separately can be written
+// after `out` without being copied into it. Writing the returned tail after the
+// value completes the object. `object` must have fewer than 15 members.
+[[nodiscard]] auto encode_head_to(json const &object, std::string_view key,
+                                  Encoding encoding, std::string &out)
+    -> std::string_view;
+// A member of an object written by the overload of `encode_head_to` below.
+using Member =
+    std::pair<std::string_view, std::variant<std::string_view, std::uint64_t>>;
+// Same as above for an object made of `members`, but writes them straight into
+// `out`, without building a json DOM first.
+[[nodiscard]] auto encode_head_to(std::span<Member const> members,
+                                  std::string_view key, Encoding encoding,
+                                  std::string &out) -> std::string_view;
+[[nodiscard]] auto decode(std::string_view bytes, Encoding encoding) -> json;
+
+[[nodiscard]] auto to_string(Encoding encoding) -> std::string_view;
+[[nodiscard]] auto encoding_from_string(std::string_view name)
+    -> std::optional<Encoding>;
+
+} // namespace codec
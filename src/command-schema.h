@@ -0,0 +1,164 @@
+#pragma once
+
+#include "binary-codec.h"
+#include "command.h"
+#include "player.h"
+#include "reflect.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// The arguments and parameters of commands, declared as structs, so that they
+// are decoded and checked once instead of looked up by each use.
+//
+// A schema reflects its fields by `SB_REFLECT`. The first `positional_args`
+// of them are the arguments of the command, in order, and the others are its
+// parameters, named as the fields with '_' replaced by '-'. Fields of
+// `std::optional` may be omitted. Fields of `std::string_view` refer to the
+// command, so the decoded schema must not outlive it.
+namespace command_schema {
+
+template <typename T>
+concept Schema = Reflected<T> && requires {
+  { T::positional_args } -> std::convertible_to<std::size_t>;
+};
+
+struct Say {
+  static constexpr std::size_t positional_args{1};
+  std::string_view content;
+
+  SB_REFLECT(Say, content)
+};
+
+struct Buy {
+  static constexpr std::size_t positional_args{1};
+  std::string_view item;
+
+  SB_REFLECT(Buy, item)
+};
+
+struct Battle {
+  static constexpr std::size_t positional_args{1};
+  std::string_view target;
+
+  SB_REFLECT(Battle, target)
+};
+
+struct Escape {
+  static constexpr std::size_t positional_args{0};
+  std::uint64_t game_id;
+
+  SB_REFLECT(Escape, game_id)
+};
+
+struct Move {
+  static constexpr std::size_t positional_args{0};
+  Vec2 direction;
+
+  SB_REFLECT(Move, direction)
+};
+
+struct Sync_world {
+  static constexpr std::size_t positional_args{0};
+  std::uint64_t baseline;
+
+  SB_REFLECT(Sync_world, baseline)
+};
+
+namespace detail {
+
+template <typename T> auto decode_value(json const &value) -> T
+{
+  if constexpr (std::same_as<T, std::string_view>) {
+    return value.get_ref<std::string const &>();
+  }
+  else {
+    if (value.is_binary()) {
+      return binary_codec::decode<T>(value.get_binary());
+    }
+    return value.get<T>();
+  }
+}
+
+// The key of the parameter of a field, which is the name of the field with
+// '_' replaced by '-'. The characters are held in place, so that the keys of a
+// schema are made at compile time.
+struct Param_key {
+  static constexpr std::size_t capacity{32};
+
+  constexpr explicit Param_key(std::string_view field) : size{field.size()}
+  {
+    std::ranges::replace_copy(field, chars.begin(), '_', '-');
+  }
+
+  [[nodiscard]] constexpr auto view() const -> std::string_view
+  {
+    return {chars.data(), size};
+  }
+
+  std::array<char, capacity> chars{};
+  std::size_t size;
+};
+
+// The keys of the fields of `T`, in order. Those of its arguments are unused.
+template <Schema T>
+inline constexpr auto param_keys{[] {
+  constexpr auto const &names{T::reflected_names};
+  static_assert(std::ranges::all_of(names, [](std::string_view name) {
+    return name.size() <= Param_key::capacity;
+  }));
+  return [&]<std::size_t... I>(std::index_sequence<I...>) {
+    return std::array{Param_key{names[I]}...};
+  }(std::make_index_sequence<names.size()>{});
+}()};
+
+} // namespace detail
+
+// @return
+//  The fields of `command` declared by `T`, or `std::nullopt` if any of them
+//  is missing or malformed.
+template <Schema T>
+[[nodiscard]] auto decode(Command const &command) -> std::optional<T>
+{
+  T schema{};
+  std::size_t index{};
+  auto complete{true};
+  try {
+    reflect_fields(schema, [&](std::string_view /*name*/, auto &field) {
+      using Field = std::remove_cvref_t<decltype(field)>;
+      auto const *const value{
+          index < T::positional_args
+              ? command.find_arg(index)
+              : command.find_param(detail::param_keys<T>[index].view())};
+      ++index;
+      if (value == nullptr) {
+        complete = complete && binary_codec::detail::Is_optional<Field>::value;
+        return;
+      }
+      if constexpr (binary_codec::detail::Is_optional<Field>::value) {
+        field = detail::decode_value<typename Field::value_type>(*value);
+      }
+      else {
+        field = detail::decode_value<Field>(*value);
+      }
+    });
+  }
+  catch (json::exception const &) {
+    return std::nullopt;
+  }
+  catch (std::runtime_error const &) {
+    return std::nullopt;
+  }
+  if (!complete) {
+    return std::nullopt;
+  }
+  return schema;
+}
+
+} // namespace command_schema
@@ -1,6 +1,4 @@
 #include "command.h"
-#include <chrono>
-#include <format>
 #include <spdlog/spdlog.h>
 
 void to_json(json &j, const Command &cmd)
@@ -19,21 +17,17 @@ Command::Command(std::string name) : _data(json::object())
 {
   // spdlog::debug("Creating command from std::string: {}", name);
   _data["name"] = name;
-  std::chrono::zoned_time now{std::chrono::current_zone(),
-                              std::chrono::system_clock::now()};
-  _data["created_time"] = std::format(
-      "{:%F %T}",
-      std::chrono::round<std::chrono::seconds>(now.get_local_time()));
+  _data["created_time"] = coarse_clock::now();
 }
 
+// The stamp of the sender is kept, so that parsing stays cheap, and the time
+// shown is when the command was made rather than received.
 Command::Command(json data) : _data(std::move(data))
 {
   // spdlog::debug("Creating command from json: {}", _data.dump());
-  std::chrono::zoned_time now{std::chrono::current_zone(),
-                              std::chrono::system_clock::now()};
-  _data["created_time"] = std::format(
-      "{:%F %T}",
-      std::chrono::round<std::chrono::seconds>(now.get_local_time()));
+  if (!_data.contains("created_time")) {
+    _data["created_time"] = coarse_clock::now();
+  }
 }
 
 auto Command::name() const -> std::string const &
@@ -45,10 +39,34 @@ auto Command::name() const -> std::string const &
   return _data["name"].get_ref<std::string const &>();
 }
 
+auto Command::opcode() const -> std::optional<Opcode>
+{
+  if (auto const it{_data.find("op")}; it != _data.end()) {
+    if (!it->is_number_unsigned() || it->get<std::size_t>() >= opcode_count) {
+      return std::nullopt;
+    }
+    return static_cast<Opcode>(it->get<std::size_t>());
+  }
+  return opcode_of(name());
+}
+
+void Command::use_opcode()
+{
+  if (auto const op{opcode_of(name())}) {
+    _data.erase("name");
+    _data["op"] = std::to_underlying(*op);
+  }
+}
+
 auto Command::dump() const -> std::string
 {
   return _data.dump();
 }
+
+auto Command::data() && -> json
+{
+  return std::move(_data);
+}
 auto Command::args() -> json &
 {
   return _data["args"];
@@ -58,7 +76,50 @@ auto Command::args() const -> json const &
 {
   return _data["args"];
 }
+auto Command::params() -> json &
+{
+  return _data["params"];
+}
+
+auto Command::params() const -> json const &
+{
+  return _data["params"];
+}
+
+auto Command::find_param(std::string_view key) const -> json const *
+{
+  auto const params{_data.find("params")};
+  if (params == _data.end() || !params->is_object()) {
+    return nullptr;
+  }
+  auto const it{params->find(key)};
+  return it != params->end() ? &*it : nullptr;
+}
+
+auto Command::find_arg(std::size_t index) const -> json const *
+{
+  auto const args{_data.find("args")};
+  if (args == _data.end() || !args->is_array() || index >= args->size()) {
+    return nullptr;
+  }
+  return &(*args)[index];
+}
+
+auto Command::created_at() const -> Timestamp
+{
+  auto const it{_data.find("created_time")};
+  if (it == _data.end() || !it->is_number_integer()) {
+    return 0;
+  }
+  return it->get<Timestamp>();
+}
+
 auto Command::created_time() const -> std::string
 {
-  return _data["created_time"].get<std::string>();
+  // Older peers stamp commands with the formatted time.
+  if (auto const it{_data.find("created_time")};
+      it != _data.end() && it->is_string()) {
+    return it->get<std::string>();
+  }
+  return format_local_time(created_at());
 }
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "binary-codec.h"
+#include "chrono.h"
 #include "json.h"
+#include "opcode.h"
+#include <optional>
+#include <string_view>
 
 using namespace std::literals;
 
@@ -18,8 +23,17 @@ public:
   explicit Command(json data);
 
   [[nodiscard]] auto name() const -> std::string const &;
+  // @return
+  //  The opcode sent in place of the name, or the one of the name otherwise.
+  //  `std::nullopt` if the command is unknown.
+  [[nodiscard]] auto opcode() const -> std::optional<Opcode>;
+  // Replaces the name by its opcode, if it has one, which is smaller and needs
+  // no string compare to dispatch. `name()` is empty afterwards.
+  void use_opcode();
 
-  // Returns the time when the command was created.
+  // Returns the time when the command was created, or `0` if unknown.
+  [[nodiscard]] auto created_at() const -> Timestamp;
+  // Same as above, formatted in the local time zone for display.
   [[nodiscard]] auto created_time() const -> std::string;
 
   // Getter and setter for parameters.
@@ -27,16 +41,32 @@ public:
   [[nodiscard]] auto get_param(std::string const &key) const -> T;
   template <typename T> void set_param(std::string const &key, T value);
 
+  // @return
+  //  The parameter of `key`, or `nullptr` if there is none.
+  [[nodiscard]] auto find_param(std::string_view key) const -> json const *;
+  [[nodiscard]] auto params() -> json &;
+  [[nodiscard]] auto params() const -> json const &;
+
   // Getter and setter for arguments.
   [[nodiscard]] auto args() -> json &;
   [[nodiscard]] auto args() const -> json const &;
   template <typename T>
   [[nodiscard]] auto get_arg(std::size_t index) const -> T;
   template <typename T> void add_arg(T arg);
+  // @return
+  //  The argument at `index`, or `nullptr` if there is none.
+  [[nodiscard]] auto find_arg(std::size_t index) const -> json const *;
+  // Adds `arg` encoded by the binary codec, which is much cheaper than
+  // `add_arg` for large values. The bytes are only carried as is by binary
+  // encodings, so use it only for peers speaking one of them.
+  template <typename T> void add_packed_arg(T const &arg);
 
   // Dumps command data into string.
   [[nodiscard]] auto dump() const -> std::string;
 
+  // Moves command data out, to be nested into a packet.
+  [[nodiscard]] auto data() && -> json;
+
 private:
   json _data;
 };
@@ -55,10 +85,21 @@ template <typename T> void Command::set_param(std::string const &key, T value)
 template <typename T>
 [[nodiscard]] auto Command::get_arg(std::size_t const index) const -> T
 {
-  return _data["args"][index].get<T>();
+  auto const &arg{_data["args"][index]};
+  if (arg.is_binary()) {
+    return binary_codec::decode<T>(arg.get_binary());
+  }
+  return arg.get<T>();
 }
 
 template <typename T> void Command::add_arg(T arg)
 {
   _data["args"].push_back(std::move(arg));
 }
+
+template <typename T> void Command::add_packed_arg(T const &arg)
+{
+  binary_codec::Bytes bytes;
+  binary_codec::encode_to(arg, bytes);
+  _data["args"].push_back(json::binary(std::move(bytes)));
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "binary-codec.h"
+#include "player.h"
+#include "random.h"
+#include "reflect.h"
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// An unreliable side channel for movement, next to the session, so that a lost
+// segment doesn't hold movement behind it, and a lost datagram is simply
+// superseded by the next one. Everything else stays on the session.
+//
+// Every datagram is a `Header` followed by the body of its type, encoded by
+// the binary codec. Each side numbers the datagrams it sends, and drops those
+// arriving after a newer one, so only the latest state is ever applied.
+namespace datagram {
+
+enum class Type : std::uint8_t {
+  // Client to server: `Move`. Also tells the server where the client is.
+  move,
+  // Server to client: `Positions`.
+  positions,
+};
+
+constexpr auto last_enumerator(Type /*type*/) -> Type
+{
+  return Type::positions;
+}
+
+struct Header {
+  // Given by the server on "open-udp", binding the datagram to the session
+  // that asked for it.
+  std::uint64_t token;
+  std::uint32_t sequence;
+  Type type;
+
+  SB_REFLECT(Header, token, sequence, type)
+};
+
+// The current direction of movement, sent repeatedly.
+struct Move {
+  Vec2 direction;
+
+  SB_REFLECT(Move, direction)
+};
+
+// Positions of the players seen by the client, its own one first.
+struct Positions {
+  std::vector<std::pair<std::string, Vec2>> players;
+
+  SB_REFLECT(Positions, players)
+};
+
+// Larger datagrams may be fragmented, or dropped, on the way. Receivers read
+// no more than this, so a larger datagram would arrive truncated.
+inline constexpr std::size_t max_size{1200};
+inline constexpr std::size_t max_positions{32};
+
+// Encoded sizes, as written by the binary codec, so that a datagram is filled
+// up to `max_size` without encoding it to find out.
+inline constexpr std::size_t header_size{
+    sizeof(Header::token) + sizeof(Header::sequence) + sizeof(Header::type)};
+inline constexpr std::size_t codec_size_size{sizeof(std::uint32_t)};
+
+[[nodiscard]] constexpr auto position_size(std::string_view name)
+    -> std::size_t
+{
+  return codec_size_size + name.size() + 2 * sizeof(float);
+}
+
+// Fills `positions` with `viewer` first, then the other `players` it can see,
+// as long as the datagram holding them fits in `max_size`.
+template <typename Players>
+void fill_positions(Positions &positions, Player const &viewer,
+                    Players const &players)
+{
+  auto size{header_size + codec_size_size};
+  auto const add{[&positions, &size](Player const &player) {
+    auto const added{position_size(player.name())};
+    if (size + added > max_size || positions.players.size() == max_positions) {
+      return false;
+    }
+    size += added;
+    positions.players.emplace_back(player.name(), player.position());
+    return true;
+  }};
+
+  if (!add(viewer)) {
+    return;
+  }
+  for (auto const &player : players) {
+    if (&player != &viewer && viewer.can_see(player) && !add(player)) {
+      break;
+    }
+  }
+}
+
+template <typename Body>
+[[nodiscard]] auto encode(Header header, Body const &body)
+    -> binary_codec::Bytes
+{
+  binary_codec::Bytes out;
+  binary_codec::encode_to(header, out);
+  binary_codec::encode_to(body, out);
+  return out;
+}
+
+// Reads the header of a datagram, leaving `reader` at the body.
+//
+// @return
+//  The header, or `std::nullopt` if the datagram is too short.
+[[nodiscard]] inline auto read_header(binary_codec::Reader &reader)
+    -> std::optional<Header>
+{
+  try {
+    Header header{};
+    reader.read(header);
+    return header;
+  }
+  catch (std::runtime_error const &) {
+    return std::nullopt;
+  }
+}
+
+// Drops datagrams arriving after a newer one.
+class Sequence_filter {
+public:
+  // @return
+  //  Whether `sequence` is newer than every one accepted before. Sequences
+  //  wrap around.
+  auto accept(std::uint32_t sequence) -> bool
+  {
+    if (_accepted_any && static_cast<std::int32_t>(sequence - _newest) <= 0) {
+      return false;
+    }
+    _accepted_any = true;
+    _newest = sequence;
+    return true;
+  }
+
+private:
+  bool _accepted_any{};
+  std::uint32_t _newest{};
+};
+
+// Drops datagrams at random, to test the channel over loopback as if it were
+// a lossy network. Not thread-safe.
+class Loss_injector {
+public:
+  // @param loss_rate The probability of dropping each datagram.
+  explicit Loss_injector(float loss_rate) : _loss_rate{loss_rate} {}
+
+  [[nodiscard]] auto should_drop() const -> bool
+  {
+    return _loss_rate > 0 && little_sb::random::probability(_loss_rate);
+  }
+
+private:
+  float _loss_rate;
+};
+
+} // namespace datagram
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "json.h"
+#include "reflect.h"
+#include <cstdint>
+#include <string_view>
+
+// Sends only the fields of reflected values that changed. Field `i` in the
+// order of reflection is bit `i` of a `Field_mask`.
+namespace delta {
+
+using Field_mask = std::uint32_t;
+
+inline constexpr Field_mask all_fields{~Field_mask{}};
+
+// @return
+//  The fields of `value` in `mask`, in order.
+template <Reflected T>
+[[nodiscard]] auto fields_to_json(T const &value, Field_mask mask) -> json
+{
+  auto fields = json::array();
+  std::size_t i{};
+  reflect_fields(value, [&](std::string_view /*name*/, auto const &field) {
+    if ((mask >> i++) & 1) {
+      fields.push_back(json(field));
+    }
+  });
+  return fields;
+}
+
+// Overwrites the fields of `value` in `mask` by `fields`, as returned by
+// `fields_to_json`.
+template <Reflected T>
+void fields_from_json(T &value, Field_mask mask, json const &fields)
+{
+  std::size_t i{};
+  std::size_t next{};
+  reflect_fields(value, [&](std::string_view /*name*/, auto &field) {
+    if ((mask >> i++) & 1) {
+      fields.at(next++).get_to(field);
+    }
+  });
+}
+
+} // namespace delta
@@ -0,0 +1,69 @@
+#include "frame.h"
+
+namespace {
+
+constexpr std::string_view newline_name{"newline"};
+constexpr std::string_view length_prefixed_name{"length-prefixed"};
+
+} // namespace
+
+auto frame::encode(Header header) -> std::array<char, Header::size>
+{
+  return {static_cast<char>((header.length >> 24) & 0xFF),
+          static_cast<char>((header.length >> 16) & 0xFF),
+          static_cast<char>((header.length >> 8) & 0xFF),
+          static_cast<char>(header.length & 0xFF),
+          static_cast<char>(header.type)};
+}
+
+auto frame::decode(char const *bytes) -> Header
+{
+  auto const byte{[bytes](std::size_t i) -> std::uint32_t {
+    return static_cast<unsigned char>(bytes[i]);
+  }};
+  return Header{.length = (byte(0) << 24) | (byte(1) << 16) | (byte(2) << 8) |
+                          byte(3),
+                .type = static_cast<Type>(bytes[4])};
+}
+
+auto frame::handshake_line(Handshake handshake) -> std::string
+{
+  std::string line{handshake_prefix};
+  switch (handshake.framing) {
+  case Framing::newline:
+    line += newline_name;
+    break;
+  case Framing::length_prefixed:
+    line += length_prefixed_name;
+    break;
+  }
+  line += ' ';
+  line += codec::to_string(handshake.encoding);
+  line += '\n';
+  return line;
+}
+
+auto frame::parse_handshake(std::string_view line) -> std::optional<Handshake>
+{
+  if (!line.starts_with(handshake_prefix)) {
+    return std::nullopt;
+  }
+  line.remove_prefix(handshake_prefix.size());
+  if (line.ends_with('\r')) {
+    line.remove_suffix(1);
+  }
+
+  auto const space{line.find(' ')};
+  auto const framing_name{line.substr(0, space)};
+  auto const encoding_name{space == std::string_view::npos
+                               ? std::string_view{}
+                               : line.substr(space + 1)};
+
+  Handshake handshake;
+  if (framing_name == length_prefixed_name) {
+    handshake.framing = Framing::length_prefixed;
+    handshake.encoding = codec::encoding_from_string(encoding_name)
+                             .value_or(codec::Encoding::json);
+  }
+  return handshake;
+}
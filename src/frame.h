@@ -0,0 +1,61 @@
+#pragma once
+
+#include "codec.h"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// How packets are delimited on the byte stream of a session.
+namespace frame {
+
+enum class Framing : std::uint8_t {
+  // Each frame is a line of text terminated by '\n'. Every session starts with
+  // this, so that peers not knowing the handshake can still talk to us.
+  newline,
+  // Each frame is a fixed-size `Header` followed by exactly `Header::length`
+  // bytes of body.
+  length_prefixed,
+};
+
+enum class Type : std::uint8_t {
+  packet,
+};
+
+struct Header {
+  static constexpr std::size_t size{5};
+
+  std::uint32_t length;
+  Type type;
+};
+
+// The length is stored in network byte order, followed by the type.
+[[nodiscard]] auto encode(Header header) -> std::array<char, Header::size>;
+[[nodiscard]] auto decode(char const *bytes) -> Header;
+
+// What a session speaks, agreed on by the handshake.
+struct Handshake {
+  Framing framing{Framing::newline};
+  codec::Encoding encoding{codec::Encoding::json};
+};
+
+// Right after connecting, the client sends one newline-terminated line like
+// "sbp-framing length-prefixed cbor" and waits for the server to answer with
+// the same kind of line, naming what it agreed on. Both sides switch right
+// after the answer. The encoding may be omitted, meaning json.
+inline constexpr std::string_view handshake_prefix{"sbp-framing "};
+
+[[nodiscard]] auto handshake_line(Handshake handshake) -> std::string;
+
+// Unknown framings and encodings are replaced by the defaults, and binary
+// encodings are replaced by json under newline framing, so that the result can
+// be used as the answer.
+//
+// @return
+//  The handshake requested by `line`, or `std::nullopt` if `line` isn't a
+//  handshake.
+[[nodiscard]] auto parse_handshake(std::string_view line)
+    -> std::optional<Handshake>;
+
+} // namespace frame
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "json.h"
+#include "reflect.h"
 #include "terrain.h"
 #include <vector>
 
@@ -21,9 +22,9 @@ public:
     // Clears and fills in the map.
     _game_map.assign(_game_map.size(),
                      std::vector<Basic_terrain>(_game_map[0].size()));
-    // `player`: std::unique_ptr<Player>
+    // `player`: Player const &
     for (auto const &player : players) {
-      auto const &dir{player->position().dir};
+      auto const &dir{player.position().dir};
       modify(dir.x, dir.y, Basic_terrain{'P'});
     }
   }
@@ -33,5 +34,5 @@ private:
   std::size_t _height;
   std::size_t _width;
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Game_map, _game_map);
+  SB_DEFINE_TYPE_INTRUSIVE(Game_map, _game_map);
 };
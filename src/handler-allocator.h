@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// Memory for the handler of one asynchronous operation at a time. Operations
+// of the same kind run one after another, so each of them reuses the memory
+// of the previous one instead of allocating its own. Handlers too large for
+// it, or started while it's in use, fall back to the heap.
+class Handler_memory {
+public:
+  static constexpr std::size_t default_capacity{256};
+
+  explicit Handler_memory(std::size_t capacity = default_capacity)
+      : _storage{new unsigned char[capacity]}, _capacity{capacity}
+  {
+  }
+  Handler_memory(Handler_memory const &) = delete;
+  Handler_memory(Handler_memory &&) = delete;
+  auto operator=(Handler_memory const &) -> Handler_memory & = delete;
+  auto operator=(Handler_memory &&) -> Handler_memory & = delete;
+  ~Handler_memory() = default;
+
+  [[nodiscard]] auto allocate(std::size_t size) -> void *
+  {
+    if (!_in_use && size <= _capacity) {
+      _in_use = true;
+      return _storage.get();
+    }
+    return ::operator new(size);
+  }
+
+  void deallocate(void *pointer)
+  {
+    if (pointer == _storage.get()) {
+      _in_use = false;
+    }
+    else {
+      ::operator delete(pointer);
+    }
+  }
+
+private:
+  // Suitably aligned for any handler, as `new[]` of bytes is.
+  std::unique_ptr<unsigned char[]> _storage;
+  std::size_t _capacity;
+  bool _in_use{};
+};
+
+// Allocator handing out `Handler_memory`. Handlers are associated with it by
+// wrapping them in a type whose `get_allocator()` returns it, as
+// `Recycling_handler` in session.cpp does.
+template <typename T> class Handler_allocator {
+  template <typename> friend class Handler_allocator;
+
+public:
+  using value_type = T;
+
+  explicit Handler_allocator(Handler_memory &memory) : _memory{&memory} {}
+
+  template <typename U>
+  Handler_allocator(Handler_allocator<U> const &other) noexcept
+      : _memory{other._memory}
+  {
+  }
+
+  [[nodiscard]] auto allocate(std::size_t n) const -> T *
+  {
+    return static_cast<T *>(_memory->allocate(sizeof(T) * n));
+  }
+
+  void deallocate(T *pointer, std::size_t /*n*/) const
+  {
+    _memory->deallocate(pointer);
+  }
+
+  template <typename U>
+  auto operator==(Handler_allocator<U> const &other) const noexcept -> bool
+  {
+    return _memory == other._memory;
+  }
+
+private:
+  Handler_memory *_memory;
+};
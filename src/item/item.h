@@ -2,6 +2,7 @@
 
 #include "effect.h"
 #include "json.h"
+#include "reflect.h"
 #include <memory>
 #include <string>
 
@@ -11,7 +12,7 @@ struct Item_info {
   std::string name;
   int price;
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Item_info, name, price);
+  SB_DEFINE_TYPE_INTRUSIVE(Item_info, name, price);
 };
 
 struct Item {
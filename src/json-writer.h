@@ -0,0 +1,240 @@
+#pragma once
+
+#include "json.h"
+#include "reflect.h"
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <concepts>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// Writes json text straight into a string while walking the values, without
+// building a DOM first. Reflected types are written as objects, the same as
+// their json conversions, so that the text can be parsed into them as usual.
+//
+// Strings may come from peers, so their bytes that aren't valid UTF-8 are
+// replaced by U+FFFD, as `nlohmann::json::error_handler_t::replace` does, and
+// the text stays valid json.
+class Json_writer {
+public:
+  explicit Json_writer(std::string &out) : _out{&out} {}
+
+  void begin_object()
+  {
+    separate();
+    *_out += '{';
+    _needs_comma = false;
+  }
+
+  void end_object()
+  {
+    *_out += '}';
+    _needs_comma = true;
+  }
+
+  void begin_array()
+  {
+    separate();
+    *_out += '[';
+    _needs_comma = false;
+  }
+
+  void end_array()
+  {
+    *_out += ']';
+    _needs_comma = true;
+  }
+
+  // Writes the key of the next member of the current object.
+  void key(std::string_view key)
+  {
+    separate();
+    write_string(key);
+    *_out += ':';
+    _needs_comma = false;
+  }
+
+  template <typename T> void write(T const &value)
+  {
+    if constexpr (std::same_as<T, bool>) {
+      separate();
+      *_out += value ? "true" : "false";
+    }
+    else if constexpr (std::is_arithmetic_v<T>) {
+      separate();
+      write_number(value);
+    }
+    else if constexpr (std::is_enum_v<T>) {
+      write(std::to_underlying(value));
+    }
+    else if constexpr (std::is_convertible_v<T const &, std::string_view>) {
+      separate();
+      write_string(value);
+    }
+    else if constexpr (std::same_as<T, json>) {
+      separate();
+      dump_to(value, *_out);
+    }
+    else if constexpr (Reflected<T>) {
+      begin_object();
+      reflect_fields(value, [this](std::string_view name, auto const &field) {
+        key(name);
+        write(field);
+      });
+      end_object();
+    }
+    else if constexpr (requires { value.first, value.second; }) {
+      begin_array();
+      write(value.first);
+      write(value.second);
+      end_array();
+    }
+    else if constexpr (requires { typename T::mapped_type; }) {
+      begin_object();
+      for (auto const &[k, v] : value) {
+        key(k);
+        write(v);
+      }
+      end_object();
+    }
+    else {
+      static_assert(std::ranges::input_range<T const>,
+                    "Type is not supported by json writer.");
+      begin_array();
+      for (auto const &element : value) {
+        write(element);
+      }
+      end_array();
+    }
+    _needs_comma = true;
+  }
+
+private:
+  void separate()
+  {
+    if (_needs_comma) {
+      *_out += ',';
+    }
+  }
+
+  template <typename T> void write_number(T value)
+  {
+    if constexpr (std::is_floating_point_v<T>) {
+      // Same as nlohmann::json.
+      if (!std::isfinite(value)) {
+        *_out += "null";
+        return;
+      }
+    }
+    std::array<char, 64> buf;
+    auto const end{
+        std::to_chars(buf.data(), buf.data() + buf.size(), value).ptr};
+    _out->append(buf.data(), end);
+  }
+
+  void write_string(std::string_view s)
+  {
+    constexpr std::string_view hex{"0123456789abcdef"};
+    *_out += '"';
+    for (std::size_t i{}; i != s.size();) {
+      auto const c{s[i]};
+      if (static_cast<unsigned char>(c) >= 0x80) {
+        auto const [size, valid]{utf8_sequence(s.substr(i))};
+        if (valid) {
+          _out->append(s.substr(i, size));
+        }
+        else {
+          *_out += "\xEF\xBF\xBD"; // U+FFFD
+        }
+        i += size;
+        continue;
+      }
+      switch (c) {
+      case '"':
+        *_out += "\\\"";
+        break;
+      case '\\':
+        *_out += "\\\\";
+        break;
+      case '\n':
+        *_out += "\\n";
+        break;
+      case '\r':
+        *_out += "\\r";
+        break;
+      case '\t':
+        *_out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          *_out += "\\u00";
+          *_out += hex[(c >> 4) & 0xF];
+          *_out += hex[c & 0xF];
+        }
+        else {
+          *_out += c;
+        }
+      }
+      ++i;
+    }
+    *_out += '"';
+  }
+
+  struct Utf8_sequence {
+    std::size_t size;
+    bool valid;
+  };
+
+  // @return
+  //  The size of the UTF-8 sequence of several bytes at the start of `s`. If
+  //  it is invalid, the size is that of its longest valid start, at least one
+  //  byte, which is replaced as a whole.
+  static auto utf8_sequence(std::string_view s) -> Utf8_sequence
+  {
+    auto const lead{static_cast<unsigned char>(s.front())};
+    std::size_t size{};
+    // Range of the byte after the lead. Every later byte is in 0x80 to 0xBF.
+    unsigned char low{0x80};
+    unsigned char high{0xBF};
+    if (lead >= 0xC2 && lead <= 0xDF) {
+      size = 2;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF) {
+      size = 3;
+      if (lead == 0xE0) {
+        low = 0xA0; // Overlong
+      }
+      else if (lead == 0xED) {
+        high = 0x9F; // Surrogates
+      }
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4) {
+      size = 4;
+      if (lead == 0xF0) {
+        low = 0x90; // Overlong
+      }
+      else if (lead == 0xF4) {
+        high = 0x8F; // Above U+10FFFF
+      }
+    }
+    else {
+      return {.size = 1, .valid = false};
+    }
+    for (std::size_t i{1}; i != size; ++i) {
+      if (i == s.size() || static_cast<unsigned char>(s[i]) < low ||
+          static_cast<unsigned char>(s[i]) > high) {
+        return {.size = i, .valid = false};
+      }
+      low = 0x80;
+      high = 0xBF;
+    }
+    return {.size = size, .valid = true};
+  }
+
+  std::string *_out;
+  bool _needs_comma{};
+};
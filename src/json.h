@@ -1,5 +1,36 @@
 #pragma once
 
 #include <nlohmann/json.hpp>
+#include <string>
 
 using nlohmann::json;
+
+// The public API of nlohmann::json only dumps into a string it creates. The
+// functions below write into a buffer of ours instead, through the serializer
+// and output adapters of `nlohmann::detail`, which have no stability
+// guarantee. They are used nowhere else, and xmake.lua pins nlohmann_json to
+// 3.11, so that an upgrade fails to build here rather than somewhere else.
+
+// Appends the compact dump of `j` to `out`. Unlike `json::dump()`, this doesn't
+// create a temporary string, so `out` can be a reused buffer.
+inline void dump_to(json const &j, std::string &out)
+{
+  nlohmann::detail::serializer<json> serializer{
+      nlohmann::detail::output_adapter<char>(out), ' '};
+  serializer.dump(j, false, false, 0);
+}
+
+// Appends the CBOR of `j` to `out`, a `std::string` or a vector of bytes.
+template <typename Bytes> void cbor_to(json const &j, Bytes &out)
+{
+  json::to_cbor(
+      j, nlohmann::detail::output_adapter<typename Bytes::value_type>(out));
+}
+
+// Appends the MessagePack of `j` to `out`, a `std::string` or a vector of
+// bytes.
+template <typename Bytes> void msgpack_to(json const &j, Bytes &out)
+{
+  json::to_msgpack(
+      j, nlohmann::detail::output_adapter<typename Bytes::value_type>(out));
+}
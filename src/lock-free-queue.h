@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+namespace detail {
+
+template <typename T> struct Queue_node {
+  std::atomic<Queue_node *> next;
+  std::optional<T> value;
+};
+
+// Nodes popped from a queue, kept for later pushes so that a queue in steady
+// state doesn't allocate. It's guarded by a try-lock: a thread finding it busy
+// allocates or frees the node itself instead of waiting.
+template <typename T> class Node_cache {
+  using Node = Queue_node<T>;
+
+public:
+  Node_cache() = default;
+  Node_cache(const Node_cache &) = delete;
+  Node_cache(Node_cache &&) = delete;
+  auto operator=(const Node_cache &) -> Node_cache & = delete;
+  auto operator=(Node_cache &&) -> Node_cache & = delete;
+  ~Node_cache()
+  {
+    while (_free != nullptr) {
+      delete std::exchange(_free, _free->next.load(std::memory_order_relaxed));
+    }
+  }
+
+  // @return
+  //  A node without value, whose `next` is null.
+  auto acquire() -> Node *
+  {
+    Node *node{};
+    if (!_busy.test_and_set(std::memory_order_acquire)) {
+      if (_free != nullptr) {
+        node = std::exchange(_free,
+                             _free->next.load(std::memory_order_relaxed));
+        --_size;
+      }
+      _busy.clear(std::memory_order_release);
+    }
+    if (node == nullptr) {
+      return new Node{};
+    }
+    node->next.store(nullptr, std::memory_order_relaxed);
+    return node;
+  }
+
+  // `node` must have no value.
+  void release(Node *node)
+  {
+    if (!_busy.test_and_set(std::memory_order_acquire)) {
+      if (_size != max_size) {
+        node->next.store(_free, std::memory_order_relaxed);
+        _free = std::exchange(node, nullptr);
+        ++_size;
+      }
+      _busy.clear(std::memory_order_release);
+    }
+    delete node;
+  }
+
+private:
+  // Beyond this, nodes are freed, so that a burst doesn't hold memory forever.
+  static constexpr std::size_t max_size{1024};
+
+  std::atomic_flag _busy;
+  Node *_free{};
+  std::size_t _size{};
+};
+
+} // namespace detail
+
+// Unbounded multi-producer single-consumer queue. `push` can be called from
+// any thread and never blocks; `try_pop` must only be called from the consumer
+// thread.
+template <typename T> class Mpsc_queue {
+  using Node = detail::Queue_node<T>;
+
+public:
+  Mpsc_queue() : _head{new Node{}}, _tail{_head.load()} {}
+  Mpsc_queue(const Mpsc_queue &) = delete;
+  Mpsc_queue(Mpsc_queue &&) = delete;
+  auto operator=(const Mpsc_queue &) -> Mpsc_queue & = delete;
+  auto operator=(Mpsc_queue &&) -> Mpsc_queue & = delete;
+  ~Mpsc_queue()
+  {
+    while (try_pop()) {
+    }
+    delete _tail;
+  }
+
+  void push(T value)
+  {
+    auto *const node{_nodes.acquire()};
+    node->value.emplace(std::move(value));
+    auto *const prev{_head.exchange(node, std::memory_order_acq_rel)};
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  auto try_pop() -> std::optional<T>
+  {
+    auto *const next{_tail->next.load(std::memory_order_acquire)};
+    if (next == nullptr) {
+      return std::nullopt;
+    }
+    auto value{std::move(next->value)};
+    next->value.reset();
+    _nodes.release(std::exchange(_tail, next));
+    return value;
+  }
+
+private:
+  detail::Node_cache<T> _nodes;
+  std::atomic<Node *> _head; // Last pushed node
+  Node *_tail;               // Dummy node before the first one to pop
+};
+
+// Unbounded single-producer single-consumer queue. `push` must only be called
+// from the producer thread, and `try_pop` from the consumer thread.
+template <typename T> class Spsc_queue {
+  using Node = detail::Queue_node<T>;
+
+public:
+  Spsc_queue() : _head{new Node{}}, _tail{_head} {}
+  Spsc_queue(const Spsc_queue &) = delete;
+  Spsc_queue(Spsc_queue &&) = delete;
+  auto operator=(const Spsc_queue &) -> Spsc_queue & = delete;
+  auto operator=(Spsc_queue &&) -> Spsc_queue & = delete;
+  ~Spsc_queue()
+  {
+    while (try_pop()) {
+    }
+    delete _tail;
+  }
+
+  void push(T value)
+  {
+    auto *const node{_nodes.acquire()};
+    node->value.emplace(std::move(value));
+    _head->next.store(node, std::memory_order_release);
+    _head = node;
+  }
+
+  auto try_pop() -> std::optional<T>
+  {
+    auto *const next{_tail->next.load(std::memory_order_acquire)};
+    if (next == nullptr) {
+      return std::nullopt;
+    }
+    auto value{std::move(next->value)};
+    next->value.reset();
+    _nodes.release(std::exchange(_tail, next));
+    return value;
+  }
+
+private:
+  detail::Node_cache<T> _nodes;
+  Node *_head; // Last pushed node, owned by the producer
+  Node *_tail; // Dummy node before the first one to pop, owned by the consumer
+};
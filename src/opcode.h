@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+// Numbers of the commands known by the server. Under a binary encoding, the
+// client sends them in place of the names, and the server finds the executor
+// of a command by indexing with them.
+enum class Opcode : std::uint8_t {
+  login,
+  logout,
+  battle,
+  buy,
+  list_store_items,
+  open_udp,
+  subscribe_events,
+  query_event,
+  sync_world,
+  sync,
+  list_players,
+  get_game_map,
+  say,
+  fuck,
+  escape,
+  resurrect,
+  move,
+};
+
+inline constexpr auto opcode_names{std::to_array<std::string_view>(
+    {"login", "logout", "battle", "buy", "list-store-items", "open-udp",
+     "subscribe-events", "query-event", "sync-world", "sync", "list-players",
+     "get-game-map", "say", "fuck", "escape", "resurrect", "move"})};
+
+inline constexpr std::size_t opcode_count{opcode_names.size()};
+static_assert(opcode_count == std::to_underlying(Opcode::move) + 1,
+              "Every opcode must have a name");
+
+[[nodiscard]] constexpr auto name_of(Opcode opcode) -> std::string_view
+{
+  return opcode_names[std::to_underlying(opcode)];
+}
+
+namespace opcode::detail {
+
+// FNV-1a, with `seed` mixed into the offset basis.
+constexpr auto opcode_hash(std::string_view name, std::uint32_t seed)
+    -> std::uint32_t
+{
+  auto hash{2166136261U ^ seed};
+  for (auto const c : name) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+inline constexpr std::size_t opcode_table_size{64};
+inline constexpr std::uint8_t no_opcode{0xFF};
+
+// The first seed sending every name to a slot of its own.
+constexpr auto find_opcode_seed() -> std::uint32_t
+{
+  for (std::uint32_t seed{};; ++seed) {
+    std::array<bool, opcode_table_size> used{};
+    auto perfect{true};
+    for (auto const name : opcode_names) {
+      auto &slot{used[opcode_hash(name, seed) % opcode_table_size]};
+      if (slot) {
+        perfect = false;
+        break;
+      }
+      slot = true;
+    }
+    if (perfect) {
+      return seed;
+    }
+  }
+}
+
+inline constexpr std::uint32_t opcode_seed{find_opcode_seed()};
+
+inline constexpr auto opcode_table{[] {
+  std::array<std::uint8_t, opcode_table_size> table{};
+  table.fill(no_opcode);
+  for (std::size_t i{}; i != opcode_count; ++i) {
+    table[opcode_hash(opcode_names[i], opcode_seed) % opcode_table_size] =
+        static_cast<std::uint8_t>(i);
+  }
+  return table;
+}()};
+
+} // namespace opcode::detail
+
+// Finds the opcode of `name` with a perfect hash built at compile time. The
+// name in the slot is compared once, to tell unknown names apart.
+[[nodiscard]] constexpr auto opcode_of(std::string_view name)
+    -> std::optional<Opcode>
+{
+  using namespace opcode::detail;
+  auto const index{
+      opcode_table[opcode_hash(name, opcode_seed) % opcode_table_size]};
+  if (index == no_opcode || opcode_names[index] != name) {
+    return std::nullopt;
+  }
+  return static_cast<Opcode>(index);
+}
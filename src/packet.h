@@ -2,7 +2,11 @@
 
 #include "json.h"
 #include "user.h"
+#include <format>
+#include <memory>
+#include <optional>
 #include <spdlog/spdlog.h>
+#include <string>
 #include <string_view>
 
 // This class should only contains POD (plain old data).
@@ -12,24 +16,90 @@ struct Packet {
 
   Packet() = default;
 
-  Packet(Sender sender, std::string payload)
-      : sender{std::move(sender)}, payload{std::move(payload)}
+  // Not braces, which would wrap a json into an array.
+  explicit Packet(json payload) : payload(std::move(payload)) {}
+
+  Packet(Sender sender, json payload)
+      : sender{std::move(sender)}, payload(std::move(payload))
+  {
+  }
+
+  // Same as `j.get<Packet>()`, but moves the payload out of `j` instead of
+  // copying it.
+  [[nodiscard]] static auto parse(json j) -> Packet
   {
+    Packet packet;
+    j.at("protocol").get_to(packet.protocol);
+    // Older peers don't send ids.
+    packet.id = j.value("id", std::uint64_t{});
+    if (auto const it{j.find("sender")}; it != j.end()) {
+      packet.sender = it->get<Sender>();
+    }
+    packet.payload = std::move(j.at("payload"));
+    // Older peers send the payload as a string of JSON.
+    if (packet.payload.is_string()) {
+      packet.payload =
+          json::parse(packet.payload.get_ref<std::string const &>());
+    }
+    return packet;
+  }
+
+  // Same as `json(packet)`, but moves the payload instead of copying it.
+  [[nodiscard]] auto into_json() && -> json
+  {
+    auto j = envelope();
+    j["payload"] = std::move(payload);
+    return j;
+  }
+
+  // All fields but the payload.
+  [[nodiscard]] auto envelope() const -> json
+  {
+    auto j = json::object();
+    j["protocol"] = protocol;
+    j["id"] = id;
+    if (sender) {
+      j["sender"] = *sender;
+    }
+    return j;
   }
 
   std::string protocol{this_protocol_name};
-  Sender sender{"Undefined username", "Undefined password"};
-  std::string payload{"Undefined body"};
+  // Correlates a reply with its request. A reply carries the id of the request
+  // it answers. `0` means the packet is neither.
+  std::uint64_t id{};
+  // Only needed until the session is authenticated. Later packets omit it.
+  std::optional<Sender> sender;
+  // The command or the event carried, nested as is, so that the whole packet
+  // is serialized and parsed only once.
+  json payload;
+  // If not null, replaces `payload` with bytes already encoded in the
+  // encoding of the session the packet is sent to. Large replies are written
+  // into it as they are produced, and sent as is, skipping the json DOM. The
+  // bytes are immutable, so that a reply can be shared by many packets.
+  std::shared_ptr<std::string const> encoded_payload;
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Packet, protocol, sender, payload)
+  friend void to_json(json &j, Packet const &packet)
+  {
+    j = Packet{packet}.into_json();
+  }
+
+  friend void from_json(json const &j, Packet &packet)
+  {
+    packet = parse(j);
+  }
 };
 
 template <> struct fmt::formatter<Packet> : fmt::formatter<std::string> {
   static auto format(Packet const &packet, format_context &ctx)
       -> decltype(ctx.out())
   {
-    return fmt::format_to(ctx.out(), "protocol={},sender={},payload={}.",
-                          packet.protocol, packet.sender.username(),
-                          packet.payload);
+    return fmt::format_to(ctx.out(), "protocol={},id={},sender={},payload={}.",
+                          packet.protocol, packet.id,
+                          packet.sender ? packet.sender->username() : "-",
+                          packet.encoded_payload
+                              ? std::format("<{} encoded bytes>",
+                                            packet.encoded_payload->size())
+                              : packet.payload.dump());
   }
 };
@@ -1,3 +1,26 @@
 #pragma once
 
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
 class Player;
+
+// Identifies a player on the server, cheaper to look up than its name. The
+// slot of a removed player is reused by later players with a new generation,
+// so that stale handles to it are told apart.
+struct Player_handle {
+  std::uint32_t index{};
+  std::uint32_t generation{};
+
+  auto operator<=>(Player_handle const &) const = default;
+};
+
+template <> struct std::hash<Player_handle> {
+  auto operator()(Player_handle handle) const noexcept -> std::size_t
+  {
+    return std::hash<std::uint64_t>{}(
+        (std::uint64_t{handle.generation} << 32) | handle.index);
+  }
+};
@@ -1,5 +1,14 @@
 #include "player.h"
 #include "random.h"
+#include <atomic>
+#include <utility>
+
+namespace {
+
+// Shared by all players, which may be built on any thread.
+std::atomic<std::uint64_t> latest_player_version{};
+
+} // namespace
 
 Player::Player(std::string name, int health, std::pair<int, int> damage_range,
                float critical_hit_rate, float critical_hit_buff, int defense,
@@ -22,6 +31,9 @@ auto Player::take_damage(int damage) -> int
 {
   damage = std::min(damage, this->_health);
   this->_health -= damage;
+  if (damage != 0) {
+    mark_dirty(Field::health);
+  }
   return damage;
 }
 
@@ -29,6 +41,7 @@ void Player::heal(int delta)
 {
   assert(delta >= 0);
   _health += delta;
+  mark_dirty(Field::health);
 }
 
 auto Player::name() const -> std::string const &
@@ -76,6 +89,7 @@ auto Player::defense() const -> int
 void Player::cost_money(int cost)
 {
   _money -= cost;
+  mark_dirty(Field::money);
 }
 
 auto Player::money() const -> int
@@ -89,6 +103,7 @@ auto Player::critical_hit_rate() const -> float
 void Player::critical_hit_rate(float rate)
 {
   _critical_hit_rate = rate;
+  mark_dirty(Field::critical_hit_rate);
 }
 auto Player::Builder::name(std::string name) -> Player::Builder &
 {
@@ -161,6 +176,11 @@ auto Player::position() const -> Vec2
 {
   return _position;
 }
+void Player::position(Vec2 position)
+{
+  _position = position;
+  mark_dirty(Field::position);
+}
 auto Player::can_see(Player const &other) const -> bool
 {
   // TODO(shelpam): Terrain effect
@@ -179,10 +199,12 @@ auto Vec2::y() const -> float
 void Player::move_direction(Vec2 dir)
 {
   _move_direction = dir;
+  mark_dirty(Field::move_direction);
 }
 
 void Player::do_move(Duration delta, Game_map const &map)
 {
+  auto const old_position{_position.dir};
   _position.dir +=
       static_cast<float>(
           std::chrono::duration_cast<std::chrono::duration<float>>(delta)
@@ -204,4 +226,56 @@ void Player::do_move(Duration delta, Game_map const &map)
   if (_position.y() >= map.width()) {
     _position.dir.y = map.width() - 1;
   }
+
+  // Most players stand still most of the time.
+  if (_position.dir != old_position) {
+    mark_dirty(Field::position);
+  }
+}
+
+auto Player::version() const -> std::uint64_t
+{
+  return _version;
+}
+
+auto Player::latest_version() -> std::uint64_t
+{
+  return latest_player_version.load(std::memory_order_relaxed);
+}
+
+auto Player::fields_changed_since(std::uint64_t version) const
+    -> delta::Field_mask
+{
+  delta::Field_mask mask{};
+  for (std::size_t i{}; i != field_count; ++i) {
+    if (_changed_at[i] > version) {
+      mask |= delta::Field_mask{1} << i;
+    }
+  }
+  return mask;
+}
+
+auto Player::take_fields_changed_since(std::uint64_t &synced_version) const
+    -> delta::Field_mask
+{
+  auto const mask{fields_changed_since(synced_version)};
+  synced_version = _version;
+  return mask;
+}
+
+auto Player::next_version() -> std::uint64_t
+{
+  return latest_player_version.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+void Player::mark_dirty(Field field)
+{
+  _version = next_version();
+  _changed_at[std::to_underlying(field)] = _version;
+}
+
+void Player::mark_all_dirty()
+{
+  _version = next_version();
+  _changed_at.fill(_version);
 }
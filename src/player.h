@@ -1,14 +1,19 @@
 #pragma once
 
 #include "chrono.h"
+#include "delta.h"
 #include "game-map.h"
 #include "item/effect.h"
 #include "json.h"
+#include "reflect.h"
 #include "uuid.h"
 #include "value-modification.h"
+#include <array>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <memory>
 #include <string>
+#include <utility>
 
 struct Vec2 {
   template <typename... Args> Vec2(Args... args) : dir{args...} {}
@@ -17,7 +22,7 @@ struct Vec2 {
 
   glm::vec2 dir;
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Vec2, dir.x, dir.y)
+  SB_DEFINE_TYPE_INTRUSIVE(Vec2, dir.x, dir.y)
 };
 
 class Player;
@@ -48,16 +53,37 @@ public:
     std::unique_ptr<Player> _player;
   };
 
+  // Fields of a player in the order of reflection, so that `Field` `i` is bit
+  // `i` of a `delta::Field_mask`.
+  enum class Field : std::uint8_t {
+    name,
+    health,
+    damage_range,
+    critical_hit_rate,
+    critical_hit_buff,
+    defense,
+    money,
+    movement_velocity,
+    visual_range,
+    position,
+    move_direction,
+  };
+  static constexpr std::size_t field_count{
+      std::to_underlying(Field::move_direction) + 1};
+
   Player() = default; // Comforms json.
 
+  // Effects may change any field, so all of them are marked dirty.
   void add_effect(std::shared_ptr<item::Effect> const &e)
   {
     e->perform(*this);
+    mark_all_dirty();
   }
 
   void remove_effect(std::shared_ptr<item::Effect> const &e)
   {
     e->deperform(*this);
+    mark_all_dirty();
   }
 
   // Don't use this because it is here for json creation. Player();
@@ -81,11 +107,30 @@ public:
   [[nodiscard]] auto money() const -> int;
 
   [[nodiscard]] auto position() const -> Vec2;
+  void position(Vec2 position);
   void do_move(Duration delta, Game_map const &map);
   void move_direction(Vec2 dir);
 
   [[nodiscard]] auto can_see(Player const &other) const -> bool;
 
+  // Numbers the changes of the player, growing with each of them. Sessions
+  // keep the version they have seen, so that each of them gets every change.
+  // Versions are drawn from one counter shared by all players, so a version
+  // also tells apart the changes of every player made after it.
+  [[nodiscard]] auto version() const -> std::uint64_t;
+  // @return
+  //  The version of the latest change of any player.
+  [[nodiscard]] static auto latest_version() -> std::uint64_t;
+  // @return
+  //  The fields changed after `version`. Every field changed after version
+  //  `0`, as no one has seen a new player yet.
+  [[nodiscard]] auto fields_changed_since(std::uint64_t version) const
+      -> delta::Field_mask;
+  // Same as `fields_changed_since(synced_version)`, then moves
+  // `synced_version` to the current version, as done when the fields are sent.
+  [[nodiscard]] auto take_fields_changed_since(
+      std::uint64_t &synced_version) const -> delta::Field_mask;
+
 private:
   Player(std::string name, int health, Damage_range damage_range,
          float critical_hit_rate, float critical_hit_buff, int defense,
@@ -93,6 +138,9 @@ private:
          glm::vec2 position);
 
   [[nodiscard]] auto damage_to(Player const &target) const -> int;
+  [[nodiscard]] static auto next_version() -> std::uint64_t;
+  void mark_dirty(Field field);
+  void mark_all_dirty();
 
   std::string _name;
   int _health{};
@@ -111,8 +159,24 @@ private:
   Vec2 _position{};
   Vec2 _move_direction{};
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Player, _name, _health, _damage_range,
-                                 _critical_hit_rate, _critical_hit_buff,
-                                 _defense, _money, _movement_velocity,
-                                 _visual_range, _position, _move_direction)
+  // Not reflected. The version of the last change of each field. A new player
+  // takes a new version for all of them, so that it is newer than what every
+  // session, or snapshot of the world, has seen.
+  std::uint64_t _version{next_version()};
+  std::array<std::uint64_t, field_count> _changed_at{[version = _version] {
+    std::array<std::uint64_t, field_count> changed_at{};
+    changed_at.fill(version);
+    return changed_at;
+  }()};
+
+  SB_DEFINE_TYPE_INTRUSIVE(Player, _name, _health, _damage_range,
+                           _critical_hit_rate, _critical_hit_buff,
+                           _defense, _money, _movement_velocity,
+                           _visual_range, _position, _move_direction)
+
+  // Reordering the reflected fields without `Field` would send each field
+  // under the bit of another one.
+  static_assert(field_count == reflected_names.size(),
+                "Player::Field must list the reflected fields in order");
+  static_assert(field_count <= sizeof(delta::Field_mask) * 8);
 };
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "json.h"
+#include <array>
+#include <string_view>
+
+#define SB_REFLECT_VISIT_FIELD(field)                                          \
+  visit(std::string_view{#field}, self.field);
+
+#define SB_REFLECT_FIELD_NAME(field) std::string_view{#field},
+
+// Defines `reflect_fields(self, visit)`, which calls `visit(name, field)` on
+// each of the listed fields of `self`, in order. The list is walked at compile
+// time, so codecs can encode the fields without going through a json DOM.
+//
+// Also defines `reflected_names`, the names of the fields in the same order,
+// usable at compile time.
+#define SB_REFLECT(Type, ...)                                                  \
+  static constexpr std::array reflected_names{NLOHMANN_JSON_EXPAND(            \
+      NLOHMANN_JSON_PASTE(SB_REFLECT_FIELD_NAME, __VA_ARGS__))};               \
+  friend void reflect_fields(Type &self, auto &&visit)                         \
+  {                                                                            \
+    NLOHMANN_JSON_EXPAND(                                                      \
+        NLOHMANN_JSON_PASTE(SB_REFLECT_VISIT_FIELD, __VA_ARGS__))              \
+  }                                                                            \
+  friend void reflect_fields(Type const &self, auto &&visit)                   \
+  {                                                                            \
+    NLOHMANN_JSON_EXPAND(                                                      \
+        NLOHMANN_JSON_PASTE(SB_REFLECT_VISIT_FIELD, __VA_ARGS__))              \
+  }
+
+// Same as `NLOHMANN_DEFINE_TYPE_INTRUSIVE`, and also reflects the same fields
+// by `SB_REFLECT`.
+#define SB_DEFINE_TYPE_INTRUSIVE(Type, ...)                                    \
+  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Type, __VA_ARGS__)                            \
+  SB_REFLECT(Type, __VA_ARGS__)
+
+template <typename T>
+concept Reflected = requires(T &value) {
+  reflect_fields(value, [](std::string_view, auto &) {});
+};
@@ -30,7 +30,7 @@ auto main(int argc, char **argv) -> int
   // the call stack information.
   try {
 #endif
-    Server::instance(1438).run();
+    Server::instance(Server_config{.bind_port = 1438}).run();
 #ifdef NDEBUG
   }
   catch (std::exception const &e) {
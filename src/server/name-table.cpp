@@ -0,0 +1,46 @@
+#include "name-table.h"
+#include <utility>
+
+auto Name_table::intern(std::string_view name) -> Id
+{
+  if (auto const id{find(name)}) {
+    return *id;
+  }
+  Id id{};
+  if (!_free_ids.empty()) {
+    id = _free_ids.back();
+    _free_ids.pop_back();
+  }
+  else {
+    id = static_cast<Id>(_names.size());
+    _names.emplace_back();
+  }
+  _names[id] = &_ids.emplace(std::string{name}, id).first->first;
+  return id;
+}
+
+void Name_table::release(Id id)
+{
+  // Erased by iterator, as the key to erase by would be the one erased.
+  auto const *const name{std::exchange(_names.at(id), nullptr)};
+  _ids.erase(_ids.find(*name));
+  _free_ids.push_back(id);
+}
+
+auto Name_table::find(std::string_view name) const -> std::optional<Id>
+{
+  if (auto const it{_ids.find(name)}; it != _ids.end()) {
+    return it->second;
+  }
+  return std::nullopt;
+}
+
+auto Name_table::name(Id id) const -> std::string const &
+{
+  return *_names.at(id);
+}
+
+auto Name_table::size() const -> std::size_t
+{
+  return _ids.size();
+}
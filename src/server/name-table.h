@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Dense integer ids of names, so that a name is hashed once when it enters
+// the server, and only the id is used from there on. A name is kept until it
+// is released, and the ids of released names are given to later ones, so that
+// the table only grows with the names in use.
+class Name_table {
+public:
+  using Id = std::uint32_t;
+
+  // @return
+  //  The id of `name`, given a new one if it has none yet.
+  auto intern(std::string_view name) -> Id;
+
+  // @return
+  //  The id of `name`, or `std::nullopt` if it has never been interned.
+  [[nodiscard]] auto find(std::string_view name) const -> std::optional<Id>;
+
+  // Forgets the name of `id`, which must be interned. The id may be given to
+  // another name from now on.
+  void release(Id id);
+
+  // `id` must be interned.
+  [[nodiscard]] auto name(Id id) const -> std::string const &;
+
+  // Number of names interned and not released.
+  [[nodiscard]] auto size() const -> std::size_t;
+
+private:
+  // Lets `std::string_view` be looked up without making a string of it.
+  struct Hash {
+    using is_transparent = void;
+    auto operator()(std::string_view s) const noexcept -> std::size_t
+    {
+      return std::hash<std::string_view>{}(s);
+    }
+  };
+
+  std::unordered_map<std::string, Id, Hash, std::equal_to<>> _ids;
+  // Keys of `_ids`, which don't move, indexed by id. Null for released ids.
+  std::vector<std::string const *> _names;
+  std::vector<Id> _free_ids;
+};
@@ -0,0 +1,74 @@
+#include "player-registry.h"
+#include "player.h"
+
+Player_registry::Player_registry() = default;
+
+Player_registry::~Player_registry() = default;
+
+auto Player_registry::get(Player_handle handle) const -> Player *
+{
+  if (handle.index >= _slots.size()) {
+    return nullptr;
+  }
+  auto const &slot{_slots[handle.index]};
+  return slot.generation == handle.generation ? slot.player.get() : nullptr;
+}
+
+auto Player_registry::find(std::string_view name) const
+    -> std::optional<Player_handle>
+{
+  auto const id{_names.find(name)};
+  if (!id || _slot_of_name[*id] == no_slot) {
+    return std::nullopt;
+  }
+  auto const index{_slot_of_name[*id]};
+  return Player_handle{.index = index, .generation = _slots[index].generation};
+}
+
+void Player_registry::remove(Player_handle handle)
+{
+  if (get(handle) == nullptr) {
+    return;
+  }
+  auto &slot{_slots[handle.index]};
+  slot.player.reset();
+  ++slot.generation;
+  // A player is the only one of its name, whose id is given to later names.
+  _slot_of_name[slot.name] = no_slot;
+  _names.release(slot.name);
+
+  // Swaps the last live slot into the place of this one.
+  auto const last{_live.back()};
+  _live[slot.live_position] = last;
+  _slots[last].live_position = slot.live_position;
+  _live.pop_back();
+
+  _free_slots.push_back(handle.index);
+}
+
+auto Player_registry::size() const -> std::size_t
+{
+  return _live.size();
+}
+
+auto Player_registry::allocate_slot() -> std::uint32_t
+{
+  if (!_free_slots.empty()) {
+    auto const index{_free_slots.back()};
+    _free_slots.pop_back();
+    return index;
+  }
+  _slots.emplace_back();
+  return static_cast<std::uint32_t>(_slots.size() - 1);
+}
+
+void Player_registry::occupy(std::uint32_t index, Name_table::Id name,
+                             std::unique_ptr<Player> player)
+{
+  auto &slot{_slots[index]};
+  slot.player = std::move(player);
+  slot.name = name;
+  slot.live_position = static_cast<std::uint32_t>(_live.size());
+  _live.push_back(index);
+  _slot_of_name[name] = index;
+}
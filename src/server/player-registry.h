@@ -0,0 +1,106 @@
+#pragma once
+
+#include "player-fwd.h"
+#include "server/name-table.h"
+#include <limits>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <string_view>
+#include <vector>
+
+// Owns the players of the server. Names are only looked up when a request
+// names a player. Everything else holds handles, which index a slot and are
+// checked against its generation, so no string is hashed or compared.
+class Player_registry {
+public:
+  Player_registry();
+  Player_registry(Player_registry const &) = delete;
+  Player_registry(Player_registry &&) = delete;
+  auto operator=(Player_registry const &) -> Player_registry & = delete;
+  auto operator=(Player_registry &&) -> Player_registry & = delete;
+  ~Player_registry();
+
+  // @return
+  //  The handle of the player of `name`. If there is none, the player is
+  //  created by `make()` first.
+  template <typename Make>
+  auto login(std::string_view name, Make &&make) -> Player_handle;
+
+  // @return
+  //  The player of `handle`, or `nullptr` if it has been removed.
+  [[nodiscard]] auto get(Player_handle handle) const -> Player *;
+
+  // @return
+  //  The handle of the player of `name`, if there is one.
+  [[nodiscard]] auto find(std::string_view name) const
+      -> std::optional<Player_handle>;
+
+  // Removes the player of `handle`, if there is one. The handle becomes
+  // stale, and is never given to another player.
+  void remove(Player_handle handle);
+
+  [[nodiscard]] auto size() const -> std::size_t;
+
+  // Handles of the players, in no particular order.
+  [[nodiscard]] auto handles() const
+  {
+    return _live | std::views::transform([this](std::uint32_t index) {
+             return Player_handle{.index = index,
+                                  .generation = _slots[index].generation};
+           });
+  }
+
+  // The players, in the same order as `handles()`.
+  [[nodiscard]] auto players() const
+  {
+    return _live |
+           std::views::transform([this](std::uint32_t index) -> Player & {
+             return *_slots[index].player;
+           });
+  }
+
+private:
+  static constexpr std::uint32_t no_slot{
+      std::numeric_limits<std::uint32_t>::max()};
+
+  struct Slot {
+    std::unique_ptr<Player> player;
+    std::uint32_t generation{};
+    Name_table::Id name{};
+    // Position of the slot in `_live`.
+    std::uint32_t live_position{};
+  };
+
+  // @return
+  //  A slot without player.
+  auto allocate_slot() -> std::uint32_t;
+  void occupy(std::uint32_t index, Name_table::Id name,
+              std::unique_ptr<Player> player);
+
+  Name_table _names;
+  std::vector<Slot> _slots;
+  std::vector<std::uint32_t> _free_slots;
+  // Slots with players, packed so that players are iterated without holes.
+  std::vector<std::uint32_t> _live;
+  // Slot of the player of each name, indexed by the id of the name.
+  std::vector<std::uint32_t> _slot_of_name;
+};
+
+template <typename Make>
+auto Player_registry::login(std::string_view name, Make &&make)
+    -> Player_handle
+{
+  auto const id{_names.intern(name)};
+  if (id == _slot_of_name.size()) {
+    _slot_of_name.push_back(no_slot);
+  }
+  if (auto const index{_slot_of_name[id]}; index != no_slot) {
+    return Player_handle{.index = index,
+                         .generation = _slots[index].generation};
+  }
+
+  auto const index{allocate_slot()};
+  occupy(index, id, std::forward<Make>(make)());
+  return Player_handle{.index = index, .generation = _slots[index].generation};
+}
@@ -1,8 +1,19 @@
 #include "server-command-executor.h"
 #include "battle.h"
 #include "command.h"
+#include "delta.h"
+#include "player.h"
 #include "server.h"
 
+Reply::Reply(Event event) : _packet{std::move(event).data()} {}
+
+Reply::Reply(Packet packet) : _packet{std::move(packet)} {}
+
+auto Reply::into_packet() && -> Packet
+{
+  return std::move(_packet);
+}
+
 Server_command_executor::Server_command_executor(Server *server)
     : _server{server}
 {
@@ -13,95 +24,264 @@ auto Server_command_executor::server() -> Server *
   return _server;
 }
 
-auto Say_server_command_executor::execute(std::string from,
-                                          Command const &command) -> Event
+auto Say_server_command_executor::execute_decoded(
+    Command_context const &context, command_schema::Say const &args) -> Reply
 {
-  auto const content{command.get_arg<std::string>(0)};
   Event broadcast{"broadcast"s};
-  broadcast.set_param("from", std::move(from));
-  broadcast.add_arg(content);
-  server()->_session_service.push_event_all(broadcast);
+  broadcast.set_param("from", context.identity.username);
+  broadcast.add_arg(std::string{args.content});
+  server()->_session_service.push_event_all(std::move(broadcast));
   return Event{"ok"};
 }
 Say_server_command_executor::Say_server_command_executor(Server *server)
+    : Typed_server_command_executor{server}
+{
+}
+
+Query_event_server_command_executor::Query_event_server_command_executor(
+    Server *server)
     : Server_command_executor{server}
 {
 }
 
-// TODO(shelpam): here commented out just for debug. Please recover here.
-//
-// auto Query_event_server_command_executor::execute(
-//     std::string /*from*/, Command const &command) -> Event
-// {
-//   auto const game_id{command.get_arg<std::int64_t>(0)};
-//   auto &game{server()->_games.at(game_id)};
-//   if (game.ended()) {
-//     server()->_games.extract(game_id);
-//     return "ended";
-//   }
-//   auto &events_queue{game.pending_events()};
-//   if (events_queue.empty()) {
-//     return "no";
-//   }
-//   auto event{std::move(events_queue.front())};
-//   events_queue.pop();
-//   return event;
-// }
-// Query_event_server_command_executor::Query_event_server_command_executor(
-//     Server *server)
-//     : Server_command_executor{server}
-// {
-// }
+auto Query_event_server_command_executor::execute(
+    Command_context const &context, Command const & /* command */) -> Reply
+{
+  return server()->_session_service.query_event_reply(
+      context.identity.player_handle, *context.session);
+}
 
 Fuck_server_command_executor::Fuck_server_command_executor(Server *server)
     : Server_command_executor{server}
 {
 }
 
-auto Fuck_server_command_executor::execute(std::string from,
-                                           Command const &command) -> Event
+auto Fuck_server_command_executor::execute(Command_context const &context,
+                                           Command const & /* command */)
+    -> Reply
 {
-  Command new_command(command.name());
-  new_command.set_param("fucker", from);
-  for (auto const &[name, _] : server()->_players) {
-    if (name != from) {
-      server()->_session_service.push_event(name, new_command);
+  auto const from{context.identity.player_handle};
+  Command new_command("fuck");
+  new_command.set_param("fucker", context.identity.username);
+  auto const event{
+      std::make_shared<Shared_event const>(std::move(new_command))};
+  for (auto const player : server()->_players.handles()) {
+    if (player != from) {
+      server()->_session_service.push_event(player, event);
     }
   }
   return Event{"ok"};
 }
 
 Escape_server_command_executor::Escape_server_command_executor(Server *server)
-    : Server_command_executor{server}
+    : Typed_server_command_executor{server}
 {
 }
 
-auto Escape_server_command_executor::execute(std::string /* from */,
-                                             Command const &command) -> Event
+auto Escape_server_command_executor::execute_decoded(
+    Command_context const &context, command_schema::Escape const &args) -> Reply
 {
-  auto const game_id{command.get_param<std::size_t>("game-id")};
-  server()->_battles.at(game_id).stop(Stop_cause::escaping);
+  server()->_battles.at(args.game_id)
+      .stop(Stop_cause::escaping, context.identity.player_handle);
   return Event{"ok"};
 }
 server_command_executors::Resurrect::Resurrect(Server *server)
     : Server_command_executor{server}
 {
 }
-auto server_command_executors::Resurrect::execute(std::string from,
-                                                  Command const &command)
-    -> Event
+auto server_command_executors::Resurrect::execute(
+    Command_context const &context, Command const & /* command */) -> Reply
 {
-  server()->_players.at(from)->heal(little_sb::random::uniform(500, 1000));
+  server()
+      ->player(context.identity.player_handle)
+      ->heal(little_sb::random::uniform(500, 1000));
   return Event{"ok"};
 }
 server_command_executors::Move::Move(Server *server)
+    : Typed_server_command_executor{server}
+{
+}
+auto server_command_executors::Move::execute_decoded(
+    Command_context const &context, command_schema::Move const &args) -> Reply
+{
+  server()
+      ->player(context.identity.player_handle)
+      ->move_direction(args.direction);
+  return Event{"ok"};
+}
+
+namespace server_command_executors {
+
+Login::Login(Server *server) : Server_command_executor{server} {}
+
+auto Login::execute(Command_context const &context,
+                    Command const & /* command */) -> Reply
+{
+  spdlog::info("{} logged in.", context.identity.username);
+  auto &player{*server()->player(context.identity.player_handle)};
+  Event e{"ok"};
+  Session_service::add_state_arg(e, *context.session, player);
+  // The whole player is sent, so syncs of this session start from here.
+  context.identity.synced_version = player.version();
+  return e;
+}
+
+Logout::Logout(Server *server) : Server_command_executor{server} {}
+
+auto Logout::execute(Command_context const &context,
+                     Command const & /* command */) -> Reply
+{
+  spdlog::info("{} logged out.", context.identity.username);
+  // Releases the player the same way as closing its last session does.
+  // Unbinding the session destroys `context.identity`.
+  server()->_session_service.log_out(*context.session);
+  return Event{"ok"};
+}
+
+Start_battle::Start_battle(Server *server)
+    : Typed_server_command_executor{server}
+{
+}
+
+auto Start_battle::execute_decoded(Command_context const &context,
+                                   command_schema::Battle const &args) -> Reply
+{
+  auto const &player_name{context.identity.username};
+  auto const target{args.target};
+  spdlog::debug("target: {}, player: {}", target, player_name);
+  if (target == player_name) {
+    Event e{"error"s};
+    e.add_arg("Can not select yourself as a component.");
+    return e;
+  }
+  auto const target_handle{server()->_players.find(target)};
+  if (!target_handle) {
+    Event e{"error"s};
+    e.add_arg("Player not found.");
+    return e;
+  }
+  auto const &game{server()->allocate_game(
+      {context.identity.player_handle, *target_handle})};
+  Event battle{"battle"s};
+  battle.set_param("from", player_name);
+  server()->_session_service.push_event(*target_handle, std::move(battle));
+  Event e{"ok"s};
+  e.set_param("game-id", game.id());
+  return e;
+}
+
+Buy::Buy(Server *server) : Typed_server_command_executor{server} {}
+
+auto Buy::execute_decoded(Command_context const &context,
+                          command_schema::Buy const &args) -> Reply
+{
+  auto &player{*server()->player(context.identity.player_handle)};
+  auto const &item{server()->_store_items[std::string{args.item}]};
+  if (player.money() < item.price) {
+    Event e{"error"};
+    e.add_arg("You don't have enough money to buy this item!");
+    return e;
+  }
+  player.cost_money(item.price);
+  // item.effect;
+  // TODO(shelpam): now only provides one goods, so not using flexible way to
+  // achieve the effect.
+  if (item.name == "First aid kit") {
+    player.heal(10);
+    Event cure{"cure"};
+    cure.add_arg(10);
+    cure.set_param("cause", "You bought First aid kit, health increase by 10");
+    server()->_session_service.push_event(context.identity.player_handle,
+                                          std::move(cure));
+  }
+  return Event{"ok"};
+}
+
+List_store_items::List_store_items(Server *server)
     : Server_command_executor{server}
 {
 }
-auto server_command_executors::Move::execute(std::string from,
-                                             Command const &command) -> Event
+
+auto List_store_items::execute(Command_context const &context,
+                               Command const & /* command */) -> Reply
+{
+  Event e{"ok"};
+  Session_service::add_state_arg(e, *context.session, server()->_store_items);
+  return e;
+}
+
+Open_udp::Open_udp(Server *server) : Server_command_executor{server} {}
+
+auto Open_udp::execute(Command_context const &context,
+                       Command const & /* command */) -> Reply
 {
-  auto const dir{command.get_param<Vec2>("direction")};
-  server()->_players.at(from)->move_direction(dir);
+  Event e{"ok"};
+  e.set_param("port", server()->_udp_channel.port());
+  e.set_param("token", server()->_udp_channel.open(
+                           context.identity.player_handle, context.session));
+  return e;
+}
+
+Subscribe_events::Subscribe_events(Server *server)
+    : Server_command_executor{server}
+{
+}
+
+auto Subscribe_events::execute(Command_context const &context,
+                               Command const & /* command */) -> Reply
+{
+  server()->_session_service.subscribe(context.identity.player_handle,
+                                       context.session);
   return Event{"ok"};
 }
+
+Sync_world::Sync_world(Server *server)
+    : Typed_server_command_executor{server}
+{
+}
+
+auto Sync_world::execute_decoded(Command_context const & /* context */,
+                                 command_schema::Sync_world const &args)
+    -> Reply
+{
+  return server()->_session_service.sync_world(args.baseline);
+}
+
+Sync::Sync(Server *server) : Server_command_executor{server} {}
+
+auto Sync::execute(Command_context const &context,
+                   Command const & /* command */) -> Reply
+{
+  auto const &player{*server()->player(context.identity.player_handle)};
+  // Each session bound to the player keeps what it has seen, so every one of
+  // them gets every change.
+  auto const mask{
+      player.take_fields_changed_since(context.identity.synced_version)};
+  if (mask == 0) {
+    return Event{"unchanged"};
+  }
+  Event e{"ok"};
+  e.set_param("mask", mask);
+  e.args() = delta::fields_to_json(player, mask);
+  return e;
+}
+
+List_players::List_players(Server *server) : Server_command_executor{server} {}
+
+auto List_players::execute(Command_context const &context,
+                           Command const & /* command */) -> Reply
+{
+  return server()->_session_service.snapshot_reply(Snapshot::players,
+                                                   *context.session);
+}
+
+Get_game_map::Get_game_map(Server *server) : Server_command_executor{server} {}
+
+auto Get_game_map::execute(Command_context const &context,
+                           Command const & /* command */) -> Reply
+{
+  return server()->_session_service.snapshot_reply(Snapshot::game_map,
+                                                   *context.session);
+}
+
+} // namespace server_command_executors
@@ -1,10 +1,34 @@
 #pragma once
 
+#include "command-schema.h"
 #include "event.h"
+#include "opcode.h"
+#include "packet.h"
+#include "player-fwd.h"
+#include "session.h"
 
 class Command;
 class Server;
 
+// What a command is executed on behalf of.
+struct Command_context {
+  Session_ptr const &session;
+  Session_identity &identity;
+};
+
+// Usually an event, but may be a packet whose payload is encoded already, such
+// as a snapshot shared by everyone asking for it in the same tick.
+class Reply {
+public:
+  Reply(Event event);
+  Reply(Packet packet);
+
+  [[nodiscard]] auto into_packet() && -> Packet;
+
+private:
+  Packet _packet;
+};
+
 class Server_command_executor {
 public:
   Server_command_executor(Server *server);
@@ -15,10 +39,10 @@ public:
   auto operator=(Server_command_executor &&)
       -> Server_command_executor & = delete;
   virtual ~Server_command_executor() = default;
-  virtual auto execute(std::string from, Command const &command) -> Event = 0;
-
-  // Since constexpr implies inline, it should be inline in derived classes.
-  virtual constexpr auto name() -> std::string = 0;
+  // Derived classes also define `static constexpr Opcode opcode`, the command
+  // they execute.
+  virtual auto execute(Command_context const &context, Command const &command)
+      -> Reply = 0;
 
   auto server() -> Server *;
 
@@ -26,67 +50,180 @@ private:
   Server *_server;
 };
 
-class Say_server_command_executor : public Server_command_executor {
+// Executor of a command declaring its arguments by `Schema`. They are decoded
+// and checked once, then handed to `execute_decoded` as typed fields.
+template <command_schema::Schema Schema>
+class Typed_server_command_executor : public Server_command_executor {
 public:
-  Say_server_command_executor(Server *server);
-  auto execute(std::string from, Command const &command) -> Event final;
-  constexpr auto name() -> std::string final
+  using Server_command_executor::Server_command_executor;
+
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final
   {
-    return "say"s;
+    auto const args{command_schema::decode<Schema>(command)};
+    if (!args) {
+      Event e{"error"};
+      e.add_arg("Missing or malformed arguments.");
+      return e;
+    }
+    return execute_decoded(context, *args);
   }
+
+  virtual auto execute_decoded(Command_context const &context,
+                               Schema const &args) -> Reply = 0;
+};
+
+class Say_server_command_executor
+    : public Typed_server_command_executor<command_schema::Say> {
+public:
+  static constexpr Opcode opcode{Opcode::say};
+  Say_server_command_executor(Server *server);
+  auto execute_decoded(Command_context const &context,
+                       command_schema::Say const &args)
+      -> Reply final;
 };
 
-// Move code in session-service.cpp here. This is temporarily unused.
+// Kept for clients that don't subscribe to events.
 class Query_event_server_command_executor : public Server_command_executor {
 public:
+  static constexpr Opcode opcode{Opcode::query_event};
   Query_event_server_command_executor(Server *server);
-  auto execute(std::string from, Command const &command) -> Event final;
-  constexpr auto name() -> std::string final
-  {
-    return "query-event"s;
-  }
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
 };
 
 class Fuck_server_command_executor : public Server_command_executor {
 public:
+  static constexpr Opcode opcode{Opcode::fuck};
   Fuck_server_command_executor(Server *server);
-  auto execute(std::string from, Command const &command) -> Event final;
-  constexpr auto name() -> std::string final
-  {
-    return "fuck"s;
-  }
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
 };
 
-class Escape_server_command_executor : public Server_command_executor {
+class Escape_server_command_executor
+    : public Typed_server_command_executor<command_schema::Escape> {
 public:
+  static constexpr Opcode opcode{Opcode::escape};
   Escape_server_command_executor(Server *server);
-  auto execute(std::string from, Command const &command) -> Event final;
-  constexpr auto name() -> std::string final
-  {
-    return "escape"s;
-  }
+  auto execute_decoded(Command_context const &context,
+                       command_schema::Escape const &args)
+      -> Reply final;
 };
 
 namespace server_command_executors {
 
 class Resurrect : public Server_command_executor {
 public:
+  static constexpr Opcode opcode{Opcode::resurrect};
   Resurrect(Server *server);
-  auto execute(std::string from, Command const &command) -> Event final;
-  constexpr auto name() -> std::string final
-  {
-    return "resurrect"s;
-  }
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
 };
 
-class Move : public Server_command_executor {
+class Move
+    : public Typed_server_command_executor<command_schema::Move> {
 public:
+  static constexpr Opcode opcode{Opcode::move};
   Move(Server *server);
-  auto execute(std::string from, Command const &command) -> Event final;
-  constexpr auto name() -> std::string final
-  {
-    return "move"s;
-  }
+  auto execute_decoded(Command_context const &context,
+                       command_schema::Move const &args)
+      -> Reply final;
+};
+
+class Login : public Server_command_executor {
+public:
+  static constexpr Opcode opcode{Opcode::login};
+  Login(Server *server);
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
+};
+
+class Logout : public Server_command_executor {
+public:
+  static constexpr Opcode opcode{Opcode::logout};
+  Logout(Server *server);
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
+};
+
+class Start_battle
+    : public Typed_server_command_executor<command_schema::Battle> {
+public:
+  static constexpr Opcode opcode{Opcode::battle};
+  Start_battle(Server *server);
+  auto execute_decoded(Command_context const &context,
+                       command_schema::Battle const &args)
+      -> Reply final;
+};
+
+class Buy
+    : public Typed_server_command_executor<command_schema::Buy> {
+public:
+  static constexpr Opcode opcode{Opcode::buy};
+  Buy(Server *server);
+  auto execute_decoded(Command_context const &context,
+                       command_schema::Buy const &args)
+      -> Reply final;
+};
+
+class List_store_items : public Server_command_executor {
+public:
+  static constexpr Opcode opcode{Opcode::list_store_items};
+  List_store_items(Server *server);
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
+};
+
+class Open_udp : public Server_command_executor {
+public:
+  static constexpr Opcode opcode{Opcode::open_udp};
+  Open_udp(Server *server);
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
+};
+
+class Subscribe_events : public Server_command_executor {
+public:
+  static constexpr Opcode opcode{Opcode::subscribe_events};
+  Subscribe_events(Server *server);
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
+};
+
+class Sync_world
+    : public Typed_server_command_executor<command_schema::Sync_world> {
+public:
+  static constexpr Opcode opcode{Opcode::sync_world};
+  Sync_world(Server *server);
+  auto execute_decoded(Command_context const &context,
+                       command_schema::Sync_world const &args)
+      -> Reply final;
+};
+
+class Sync : public Server_command_executor {
+public:
+  static constexpr Opcode opcode{Opcode::sync};
+  Sync(Server *server);
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
+};
+
+// Replies that grow with the world are shared by everyone asking for them in
+// the same tick.
+class List_players : public Server_command_executor {
+public:
+  static constexpr Opcode opcode{Opcode::list_players};
+  List_players(Server *server);
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
+};
+
+class Get_game_map : public Server_command_executor {
+public:
+  static constexpr Opcode opcode{Opcode::get_game_map};
+  Get_game_map(Server *server);
+  auto execute(Command_context const &context, Command const &command)
+      -> Reply final;
 };
 
 } // namespace server_command_executors
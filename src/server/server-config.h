@@ -0,0 +1,29 @@
+#pragma once
+
+#include "session.h"
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+struct Server_config {
+  std::uint16_t bind_port{1438};
+  // Port of the datagram channel for movement.
+  std::uint16_t udp_port{1439};
+  // Probability of dropping each datagram, to test the datagram channel over
+  // loopback.
+  float udp_loss_rate{};
+
+  // Number of threads reading and writing sockets. The simulation always runs
+  // on its own thread, apart from them.
+  std::size_t network_threads{std::max(1U, std::thread::hardware_concurrency())};
+
+  Session_limits session_limits{.idle_timeout = std::chrono::minutes{5},
+                                .read_timeout = std::chrono::seconds{30}};
+  // Events queued for each player not subscribed to them. The oldest ones are
+  // dropped beyond this.
+  std::size_t max_queued_events{256};
+
+  // Ticks run at once to catch up after a stall. Time beyond them is dropped,
+  // so that a long stall doesn't make the simulation rush for long.
+  std::size_t max_catch_up_ticks{5};
+};
@@ -1,13 +1,18 @@
 #include "server.h"
 #include "battle.h"
+#include "chrono.h"
 #include "player.h"
+#include "random.h"
 #include "server-command-executor.h"
+#include "tick-scheduler.h"
 #include <source_location>
 #include <spdlog/spdlog.h>
+#include <thread>
+#include <vector>
 
-auto Server::instance(std::uint16_t bind_port) -> Server &
+auto Server::instance(Server_config const &config) -> Server &
 {
-  static Server the_instance{bind_port};
+  static Server the_instance{config};
   return the_instance;
 }
 
@@ -15,9 +20,29 @@ void Server::run()
 {
   spdlog::trace("Call {}", std::source_location::current().function_name());
 
-  spdlog::info("Server started. Accepting connections...");
+  spdlog::info("Server started with {} network threads. Accepting "
+               "connections...",
+               _config.network_threads);
   _session_service.start();
-  run_main_game_loop();
+  _udp_channel.start();
+
+  {
+    auto const work_guard{asio::make_work_guard(_io_context)};
+    std::vector<std::jthread> network_threads;
+    network_threads.reserve(_config.network_threads);
+    for (std::size_t i{}; i != _config.network_threads; ++i) {
+      network_threads.emplace_back([this] { _io_context.run(); });
+    }
+
+    // This thread becomes the simulation thread, the only one touching
+    // players, battles and events.
+    run_main_game_loop();
+
+    _session_service.stop();
+    _udp_channel.stop();
+    _io_context.stop();
+  }
+
   spdlog::info("Server running ended.");
 }
 
@@ -25,7 +50,6 @@ void Server::shutdown()
 {
   spdlog::info("Server shutting down...");
 
-  _session_service.stop();
   _main_game_loop_should_stop = true;
 }
 
@@ -34,19 +58,37 @@ auto Server::io_context() -> asio::io_context &
   return _io_context;
 }
 
-Server::Server(std::uint16_t bind_port)
+Server::Server(Server_config const &config)
     : _game_map{10, 20},
       _store_items{{"First aid kit",
                     item::Item_info{.name{"First aid kit"}, .price = 3}}},
-      _session_service(this, bind_port, "Server")
+      _config{config},
+      _session_service(this, config.bind_port, config.session_limits,
+                       config.max_queued_events, "Server"),
+      _udp_channel{this, _io_context, config.udp_port, config.udp_loss_rate}
 {
   register_command_executor<Say_server_command_executor>();
+  register_command_executor<Query_event_server_command_executor>();
   register_command_executor<Escape_server_command_executor>();
   register_command_executor<Fuck_server_command_executor>();
   register_command_executor<server_command_executors::Resurrect>();
   register_command_executor<server_command_executors::Move>();
-  // register_command_executor(
-  //     std::make_unique<Query_event_server_command_executor>(this));
+  register_command_executor<server_command_executors::Login>();
+  register_command_executor<server_command_executors::Logout>();
+  register_command_executor<server_command_executors::Start_battle>();
+  register_command_executor<server_command_executors::Buy>();
+  register_command_executor<server_command_executors::List_store_items>();
+  register_command_executor<server_command_executors::Open_udp>();
+  register_command_executor<server_command_executors::Subscribe_events>();
+  register_command_executor<server_command_executors::Sync_world>();
+  register_command_executor<server_command_executors::Sync>();
+  register_command_executor<server_command_executors::List_players>();
+  register_command_executor<server_command_executors::Get_game_map>();
+}
+
+auto Server::command_executor(Opcode opcode) const -> Server_command_executor *
+{
+  return _command_executors[std::to_underlying(opcode)].get();
 }
 
 constexpr auto Server::tick_interval()
@@ -55,18 +97,55 @@ constexpr auto Server::tick_interval()
   return static_cast<std::chrono::nanoseconds>(1s) / max_tick_per_second;
 }
 
-void Server::remove_player(std::string const &player_name)
+auto Server::login(std::string const &player_name) -> Player_handle
+{
+  return _players.login(player_name, [&player_name] {
+    auto d1{little_sb::random::uniform(80, 100)};
+    auto d2{little_sb::random::uniform(80, 100)};
+    if (d1 > d2) {
+      std::swap(d1, d2);
+    };
+    glm::vec2 position{little_sb::random::uniform(0, 9),
+                       little_sb::random::uniform(0, 19)};
+    return Player::Builder{}
+        .name(player_name)
+        .health(little_sb::random::uniform(2000, 3000))
+        .damage_range({d1, d2})
+        .critical_hit_rate(little_sb::random::uniform(0.3, 0.5))
+        .critical_hit_buff(1.5)
+        .defense(little_sb::random::uniform(20, 30))
+        .money(100)
+        .movement_volecity(2)
+        .visual_range(15)
+        .position(position)
+        .build();
+  });
+}
+
+auto Server::player(Player_handle handle) const -> Player *
+{
+  return _players.get(handle);
+}
+
+void Server::remove_player(Player_handle handle)
 {
   spdlog::trace("Call {}", std::source_location::current().function_name());
 
-  _players.extract(player_name);
+  // Ended first, so that the opponents are told while the player is there.
+  for (auto &[_, battle] : _battles) {
+    if (!battle.ended() && battle.involves(handle)) {
+      battle.stop(Stop_cause::escaping, handle);
+    }
+  }
+  _players.remove(handle);
 }
 
-auto Server::allocate_game(std::array<Player *, 2> players) -> Battle &
+auto Server::allocate_game(std::array<Player_handle, 2> players) -> Battle &
 {
   auto const id{_battles.empty() ? std::uint64_t{}
                                  : _battles.rbegin()->first + 1};
-  return _battles.try_emplace(id, Battle{id, players, &_session_service})
+  return _battles
+      .try_emplace(id, Battle{id, players, &_players, &_session_service})
       .first->second;
 }
 
@@ -74,32 +153,42 @@ void Server::run_main_game_loop()
 {
   spdlog::info("Main game loop started");
 
-  auto last_update{std::chrono::steady_clock::now()};
+  Tick_scheduler scheduler{tick_interval(), _config.max_catch_up_ticks,
+                           Tick_scheduler::Clock::now()};
   while (!_main_game_loop_should_stop) {
-    // Since the server keeps accepting connections, the io_context will never
-    // runs out of its work, and will never stop. Thus we don't have to restart
-    _io_context.poll();
-
-    auto const now{std::chrono::steady_clock::now()};
-    auto const delta{now - last_update};
+    coarse_clock::tick();
 
-    if (now >= last_update + tick_interval()) {
-      for (auto &[_, battle] : _battles) {
-        battle.update(delta);
-      }
+    // Handles packets queued by the network threads.
+    _session_service.handle_received();
+    _udp_channel.handle_received();
 
-      last_update = std::chrono::steady_clock::now();
+    auto const ticks{scheduler.begin(Tick_scheduler::Clock::now())};
+    for (std::size_t i{}; i != ticks; ++i) {
+      update(scheduler.interval());
     }
-
-    for (auto &[_, player] : _players) {
-      player->do_move(delta, _game_map);
+    if (ticks != 0) {
+      _udp_channel.send_positions();
     }
-    _game_map.update(_players | std::views::values);
+    scheduler.end(Tick_scheduler::Clock::now());
 
-    std::this_thread::sleep_until(now + tick_interval());
+    std::this_thread::sleep_until(scheduler.next_tick());
   }
 
-  spdlog::info("Main game loop over");
+  auto const &stats{scheduler.stats()};
+  spdlog::info("Main game loop over after {} ticks, {} missed, {} overrun.",
+               stats.ticks, stats.missed, stats.overruns);
+}
+
+void Server::update(Duration delta)
+{
+  ++_tick;
+  for (auto &[_, battle] : _battles) {
+    battle.update(delta);
+  }
+  for (auto &player : _players.players()) {
+    player.do_move(delta, _game_map);
+  }
+  _game_map.update(_players.players());
 }
 
 auto Server::verify_userinfo(Packet::Sender const &user) const -> bool
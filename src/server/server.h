@@ -1,16 +1,22 @@
 #pragma once
 
 #include "battle-fwd.h"
+#include "chrono.h"
 #include "game-map.h"
 #include "item/item.h"
+#include "opcode.h"
 #include "packet.h"
+#include "player-fwd.h"
 #include "server/server-command-executor.h"
+#include "server/player-registry.h"
+#include "server/server-config.h"
 #include "server/session-service.h"
+#include "server/udp-channel.h"
+#include <array>
 #include <asio.hpp>
 #include <map>
 
 class Command;
-class Player;
 struct Packet;
 class Server_command_executor;
 
@@ -21,18 +27,32 @@ class Server {
   friend class Escape_server_command_executor;
   friend class server_command_executors::Resurrect;
   friend class server_command_executors::Move;
+  friend class server_command_executors::Login;
+  friend class server_command_executors::Logout;
+  friend class server_command_executors::Start_battle;
+  friend class server_command_executors::Buy;
+  friend class server_command_executors::List_store_items;
+  friend class server_command_executors::Open_udp;
+  friend class server_command_executors::Subscribe_events;
+  friend class server_command_executors::Sync_world;
+  friend class server_command_executors::Sync;
+  friend class server_command_executors::List_players;
+  friend class server_command_executors::Get_game_map;
 
 private:
   friend class Session_service;
+  friend class Udp_channel;
 
 public:
-  static auto instance(std::uint16_t bind_port = 0) -> Server &;
+  // `config` is only used by the first call.
+  static auto instance(Server_config const &config = {}) -> Server &;
   void run();
   void shutdown();
+  // Runs network io, on the network threads.
   auto io_context() -> asio::io_context &;
 
 private:
-  explicit Server(std::uint16_t bind_port);
+  explicit Server(Server_config const &config);
 
   [[nodiscard]] static constexpr auto tick_interval();
 
@@ -41,24 +61,45 @@ private:
     requires(std::derived_from<Derived_server_command_executor,
                                Server_command_executor>)
   void register_command_executor();
+  // @return
+  //  The executor of `opcode`, or `nullptr` if none is registered.
+  [[nodiscard]] auto command_executor(Opcode opcode) const
+      -> Server_command_executor *;
 
-  void remove_player(std::string const &player_name);
-  auto allocate_game(std::array<Player *, 2> players) -> Battle &;
+  // Creates the player of `player_name` if it doesn't exist yet.
+  //
+  // @return
+  //  The handle of the player.
+  auto login(std::string const &player_name) -> Player_handle;
+  // @return
+  //  The player of `handle`, or `nullptr` if it has been removed.
+  [[nodiscard]] auto player(Player_handle handle) const -> Player *;
+  // Ends the battles of the player, and removes it.
+  void remove_player(Player_handle handle);
+  auto allocate_game(std::array<Player_handle, 2> players) -> Battle &;
   void run_main_game_loop();
+  // Advances the world by a tick of `delta`.
+  void update(Duration delta);
   [[nodiscard]] auto verify_userinfo(Packet::Sender const &user) const -> bool;
 
   std::atomic<bool> _main_game_loop_should_stop;
+  // The current tick. Starts at 1, as the baseline `0` of sync-world asks for
+  // the whole world.
+  std::uint64_t _tick{1};
 
   Game_map _game_map; // Should be updated in each update of frames.
 
   std::map<Battle_id, Battle> _battles;
   std::map<std::string, item::Item_info> _store_items;
-  std::map<std::string, std::unique_ptr<Player>> _players;
-  std::map<std::string, std::unique_ptr<Server_command_executor>>
-      _server_commands;
+  Player_registry _players;
+  // Indexed by opcode.
+  std::array<std::unique_ptr<Server_command_executor>, opcode_count>
+      _command_executors;
 
+  Server_config _config;
   asio::io_context _io_context;
   Session_service _session_service;
+  Udp_channel _udp_channel;
 
   static constexpr std::size_t max_tick_per_second{10};
 };
@@ -68,7 +109,7 @@ template <typename Derived_server_command_executor>
                              Server_command_executor>)
 void Server::register_command_executor()
 {
-  auto executor{std::make_unique<Derived_server_command_executor>(this)};
-  auto name{executor->name()};
-  _server_commands.insert({name, std::move(executor)});
+  _command_executors[std::to_underlying(
+      Derived_server_command_executor::opcode)] =
+      std::make_unique<Derived_server_command_executor>(this);
 }
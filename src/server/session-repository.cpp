@@ -3,46 +3,80 @@
 #include "session.h"
 #include <spdlog/spdlog.h>
 
-Session_repository::Session_repository(asio::io_context &io_context,
-                                       std::uint16_t port,
-                                       std::function<Packet(Packet)> on_read)
-    : _acceptor{io_context, tcp::endpoint{tcp::v6(), port}},
-      _on_read{std::move(on_read)}
+Session_repository::Session_repository(
+    asio::io_context &io_context, std::uint16_t port, Session_limits limits,
+    std::function<void(Session_ptr const &, Packet)> on_read,
+    std::function<void(Session_ptr const &)> on_close)
+    : _io_context{io_context},
+      _acceptor{io_context, tcp::endpoint{tcp::v6(), port}}, _limits{limits},
+      _on_read{std::move(on_read)}, _on_close{std::move(on_close)}
 {
 }
 
 void Session_repository::do_accept()
 {
-  _acceptor.async_accept([this](std::error_code ec, tcp::socket socket) {
-    spdlog::debug("Accepting new connection. {} other sessions are alive.",
-                  _sessions_should_read.size());
-    if (ec) {
-      spdlog::warn("On accepting connection: {}", ec.message());
-    }
-    else {
-      spdlog::trace(
-          "Connection accepted, Session scheduling continuous reading...");
-      auto const session{std::make_shared<Session>(std::move(socket))};
-      _sessions_should_read.emplace(session, true);
-      do_read(session);
-    }
-    do_accept();
-  });
+  _acceptor.async_accept(
+      asio::make_strand(_io_context),
+      [this](std::error_code ec, tcp::socket socket) {
+        std::unique_lock lock{_sessions_mutex};
+        spdlog::debug("Accepting new connection. {} other sessions are alive.",
+                      _sessions_should_read.size());
+        if (ec) {
+          spdlog::warn("On accepting connection: {}", ec.message());
+        }
+        else {
+          spdlog::trace(
+              "Connection accepted, Session scheduling continuous reading...");
+          auto const session{std::make_shared<Session>(
+              std::move(socket), frame::Handshake{}, _limits)};
+          _sessions_should_read.emplace(session, true);
+          lock.unlock();
+          // Weak, since the session holds the handler.
+          session->on_close([this, weak{std::weak_ptr{session}}] {
+            auto const session{weak.lock()};
+            if (session == nullptr) {
+              return;
+            }
+            {
+              std::lock_guard lock{_sessions_mutex};
+              _sessions_should_read.erase(session);
+            }
+            _on_close(session);
+          });
+          do_read(session);
+        }
+        do_accept();
+      });
 }
 
 void Session_repository::do_read(Session_ptr const &session)
 {
-  session->schedule_read([this, session](Packet packet) {
-    session->schedule_write(_on_read(std::move(packet)), [this, session] {
-      if (_sessions_should_read[session]) {
-        do_read(session);
-      }
-    });
+  // Captures a weak pointer, since the handler is kept by the session itself.
+  session->schedule_read_batch([this, weak{std::weak_ptr{session}}](
+                                   std::vector<Packet> packets) {
+    auto const self{weak.lock()};
+    if (!self) {
+      return;
+    }
+    for (auto &packet : packets) {
+      _on_read(self, std::move(packet));
+    }
+
+    // Replies carry the ids of their requests, so we don't have to wait for
+    // them to be sent before reading the next requests.
+    // Closed sessions are erased, and mustn't be read again.
+    std::unique_lock lock{_sessions_mutex};
+    if (auto const it{_sessions_should_read.find(self)};
+        it != _sessions_should_read.end() && it->second) {
+      lock.unlock();
+      do_read(self);
+    }
   });
 }
 
 void Session_repository::do_close()
 {
+  std::lock_guard lock{_sessions_mutex};
   for (auto &[session, should_read] : _sessions_should_read) {
     should_read = false;
   }
@@ -1,22 +1,35 @@
 #pragma once
 
+#include "session.h"
 #include "session_fwd.h"
 #include <asio.hpp>
 #include <map>
+#include <mutex>
 
 using asio::ip::tcp;
 class Packet;
 
+// Accepts connections and keeps reading from them. Each accepted session gets
+// its own strand, so sessions are served concurrently when the io_context is
+// run by many threads. `on_read` is called on the strand of the session that
+// read the packet, and `on_close` on the strand of the session closed. Closed
+// sessions are forgotten, so that they are freed once nothing else holds them.
 class Session_repository {
 public:
-  explicit Session_repository(asio::io_context &io_context, std::uint16_t port,
-                              std::function<Packet(Packet)> on_read);
+  explicit Session_repository(
+      asio::io_context &io_context, std::uint16_t port, Session_limits limits,
+      std::function<void(Session_ptr const &, Packet)> on_read,
+      std::function<void(Session_ptr const &)> on_close);
   void do_accept();
   void do_read(Session_ptr const &session);
   void do_close();
 
 private:
+  asio::io_context &_io_context;
   asio::ip::tcp::acceptor _acceptor;
-  std::map<Session_ptr, std::atomic<bool>> _sessions_should_read;
-  std::function<Packet(Packet)> _on_read;
+  Session_limits _limits;
+  std::mutex _sessions_mutex;
+  std::map<Session_ptr, bool> _sessions_should_read;
+  std::function<void(Session_ptr const &, Packet)> _on_read;
+  std::function<void(Session_ptr const &)> _on_close;
 };
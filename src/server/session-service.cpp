@@ -1,19 +1,97 @@
 #include "session-service.h"
 #include "battle.h"
 #include "command.h"
+#include "delta.h"
+#include "json-writer.h"
 #include "packet.h"
 #include "player.h"
 #include "server-command-executor.h"
 #include "server.h"
+#include "session.h"
+#include <ranges>
+
+namespace {
+
+// Encodes an "ok" event with `state` as its argument into `out`. Unlike
+// `Event::add_arg`, this neither copies `state` into a json DOM nor needs it to
+// be a container, so views can be passed.
+void encode_ok_reply(auto const &state, codec::Encoding encoding,
+                     std::string &out)
+{
+  Event e{"ok"};
+  if (encoding != codec::Encoding::json) {
+    e.add_packed_arg(state);
+    codec::encode_to(std::move(e).data(), encoding, out);
+    return;
+  }
+
+  auto const data = std::move(e).data();
+  Json_writer writer{out};
+  writer.begin_object();
+  for (auto const &[key, value] : data.items()) {
+    writer.key(key);
+    writer.write(value);
+  }
+  writer.key("args");
+  writer.begin_array();
+  writer.write(state);
+  writer.end_array();
+  writer.end_object();
+}
+
+// Folds the params of the health drop `other` into those of `params` if both
+// are of the same player in the same battle, so that a client falling behind
+// catches up with one event.
+auto merge_health_drops(json &params, json const &other) -> bool
+{
+  if (params.at("player") != other.at("player") ||
+      params.at("game-id") != other.at("game-id")) {
+    return false;
+  }
+  params["drop"] = params["drop"].get<int>() + other.at("drop").get<int>();
+  params["rounds"] =
+      params["rounds"].get<int>() + other.at("rounds").get<int>();
+  return true;
+}
+
+// Only health drops are coalesced. They are keyed by battle and player, and
+// the merge checks those again in case of a collision of the hashes.
+auto coalescing_of(Event const &event) -> Coalescing
+{
+  if (event.name() != "health-drop") {
+    return {};
+  }
+  auto const key{std::hash<std::string>{}(
+      std::format("{}/{}", event.get_param<std::uint64_t>("game-id"),
+                  event.get_param<std::string>("player")))};
+  return {.key = key | 1, .merge = [](Packet &queued, Packet &later) {
+            return merge_health_drops(queued.payload.at("params"),
+                                      later.payload.at("params"));
+          }};
+}
+
+auto error_reply(std::string message) -> Packet
+{
+  Event e{"error"};
+  e.add_arg(std::move(message));
+  return Packet{std::move(e).data()};
+}
+
+} // namespace
 
 Session_service::Session_service(Server *server, std::uint16_t port,
+                                 Session_limits limits,
+                                 std::size_t max_queued_events,
                                  std::string name)
     : _server{server},
-      _session_repo{server->io_context(), port,
-                    [this](Packet packet) -> Packet {
-                      return on_reading_packet(std::move(packet));
+      _session_repo{server->io_context(), port, limits,
+                    [this](Session_ptr const &session, Packet packet) {
+                      on_received(session, std::move(packet));
+                    },
+                    [this](Session_ptr const &session) {
+                      on_closed(session);
                     }},
-      _name{std::move(name)}
+      _max_queued_events{max_queued_events}, _name{std::move(name)}
 {
 }
 
@@ -27,182 +105,330 @@ void Session_service::stop()
   _session_repo.do_close();
 }
 
-void Session_service::push_event(std::string const &player, Event event)
+void Session_service::push_event(Player_handle player, Event event)
 {
-  _events[player].push(std::move(event));
+  // An event sent to one player only is sent as is, without sharing it.
+  if (auto const session{subscriber(player)}) {
+    auto const coalescing{coalescing_of(event)};
+    session->send(Packet{std::move(event).data()}, coalescing);
+    return;
+  }
+
+  // The queued event is shared, so the one queued last is folded into `event`
+  // instead, which then replaces it.
+  auto &queue{_events[player]};
+  if (!queue.empty() && event.name() == "health-drop" &&
+      queue.back()->event().name() == "health-drop" &&
+      merge_health_drops(event.params(), queue.back()->event().params())) {
+    queue.back() = std::make_shared<Shared_event const>(std::move(event));
+    return;
+  }
+  push_event(player, std::make_shared<Shared_event const>(std::move(event)));
 }
 
-void Session_service::push_event_all(Event const &event)
+void Session_service::push_event(Player_handle player,
+                                 Shared_event_ptr const &event)
 {
-  for (auto &[_, queue] : _events) {
-    queue.push(event);
+  if (auto const session{subscriber(player)}) {
+    send_event(*session, *event);
+    return;
+  }
+
+  auto &queue{_events[player]};
+  if (queue.size() >= _max_queued_events) {
+    spdlog::warn("Too many events queued for player {}, dropping the oldest "
+                 "one.",
+                 player.index);
+    queue.pop();
   }
+  queue.push(std::move(event));
 }
 
-// Assume that there exitsts at least one evnet.
-auto Session_service::pop_event(std::string const &player) -> Event
+void Session_service::push_event_all(Event event)
 {
-  auto event{std::move(_events[player].front())};
-  _events[player].pop();
-  return event;
+  auto const shared{std::make_shared<Shared_event const>(std::move(event))};
+  for (auto const player : _server->_players.handles()) {
+    push_event(player, shared);
+  }
 }
 
-auto Session_service::on_reading_packet(Packet packet) -> Packet
+void Session_service::subscribe(Player_handle player,
+                                Session_ptr const &session)
 {
-  if (packet.protocol != Packet::this_protocol_name) {
-    spdlog::warn("Packet protocol is different from ours: {}", packet.protocol);
-    json reply("Protocol error: {} used.");
-    return Packet{Packet::Sender{"Server", "Server"}, reply.dump()};
+  _subscribers.insert_or_assign(player, session);
+
+  if (auto const it{_events.find(player)}; it != _events.end()) {
+    for (auto &queue{it->second}; !queue.empty(); queue.pop()) {
+      send_event(*session, *queue.front());
+    }
+    _events.erase(it);
   }
+}
 
-  if (!_server->verify_userinfo(packet.sender)) {
-    return Packet{Packet::Sender{_name, _name},
-                  json("Wrong username or password.").dump()};
+auto Session_service::subscriber(Player_handle player) -> Session_ptr
+{
+  auto const it{_subscribers.find(player)};
+  if (it == _subscribers.end()) {
+    return nullptr;
+  }
+  auto session{it->second.lock()};
+  if (session == nullptr) {
+    _subscribers.erase(it);
   }
+  return session;
+}
 
-  // TODO(shelpam): We must consider sign-ups, but for now just ignore it.
-  Command const player_command{json::parse(std::move(packet.payload))};
-  auto const reply{handle_command(packet.sender.username(), player_command)};
-  return Packet{Packet::Sender{_name, _name}, reply.dump()};
-}
-
-auto Session_service::handle_command(std::string const &player_name,
-                                     Command const &command) -> Event
-{
-  spdlog::trace("Handling player's command");
-
-  spdlog::debug("Received command: {}", command.dump());
-
-  // We create new information if the player instance doesn't exist. So here the
-  // player should be existing.
-  if (!_server->_players.contains(player_name)) {
-    auto d1{little_sb::random::uniform(80, 100)};
-    auto d2{little_sb::random::uniform(80, 100)};
-    if (d1 > d2) {
-      std::swap(d1, d2);
-    };
-    glm::vec2 position{little_sb::random::uniform(0, 9),
-                       little_sb::random::uniform(0, 19)};
-    _server->_players.insert(
-        {player_name,
-         Player::Builder{}
-             .name(player_name)
-             .health(little_sb::random::uniform(2000, 3000))
-             .damage_range({d1, d2})
-             .critical_hit_rate(little_sb::random::uniform(0.3, 0.5))
-             .critical_hit_buff(1.5)
-             .defense(little_sb::random::uniform(20, 30))
-             .money(100)
-             .movement_volecity(2)
-             .visual_range(15)
-             .position(position)
-             .build()});
-  }
-
-  auto const &player{_server->_players.at(player_name)};
-
-  // TODO(ShelpAm): add authentication.
-  if (command.name() == "login") {
-    spdlog::info("{} logged in.", player_name);
-    Event e{"ok"};
-    e.add_arg(*player);
-    return e;
+// Pushes are packets without id. Writes are coalesced by the session, so a
+// burst of events reaches the client in a single write.
+void Session_service::send_event(Session &session,
+                                 Shared_event const &event) const
+{
+  // Events that may be merged are kept as json, for the merge to read them.
+  if (auto const coalescing{coalescing_of(event.event())};
+      coalescing.key != 0) {
+    session.send(Packet{json(event.event())}, coalescing);
+    return;
   }
+  Packet packet;
+  packet.encoded_payload = event.encoded(session.encoding());
+  session.send(std::move(packet));
+}
 
-  if (command.name() == "logout") {
-    spdlog::info("{} logged out.", player_name);
-    _server->remove_player(player_name);
-    Event e{"ok"};
-    return e;
+auto Session_service::query_event_reply(Player_handle player,
+                                        Session const &session) -> Packet
+{
+  auto const it{_events.find(player)};
+  if (it == _events.end() || it->second.empty()) {
+    return Packet{json(Event{"none"})};
   }
+  auto const event{std::move(it->second.front())};
+  it->second.pop();
 
-  if (command.name() == "battle") {
-    auto const &target{command.get_arg<std::string>(0)};
-    spdlog::debug("target: {}, player: {}", target, player_name);
-    if (target == player_name) {
-      Event e{"error"s};
-      e.add_arg("Can not select yourself as a component.");
-      return e;
+  Packet reply;
+  reply.encoded_payload = event->encoded(session.encoding());
+  return reply;
+}
+
+auto Session_service::snapshot_reply(Snapshot snapshot,
+                                     Session const &session) -> Packet
+{
+  auto const make{[this, snapshot,
+                   encoding{session.encoding()}](std::string &out) {
+    switch (snapshot) {
+    case Snapshot::players:
+      encode_ok_reply(_server->_players.players(), encoding, out);
+      break;
+    case Snapshot::game_map:
+      encode_ok_reply(_server->_game_map, encoding, out);
+      break;
     }
-    if (!_server->_players.contains(target)) {
-      Event e{"error"s};
-      e.add_arg("Player not found.");
-      return e;
+  }};
+
+  Packet reply;
+  reply.encoded_payload =
+      _snapshots.get(_server->_tick, snapshot, session.encoding(), make);
+  return reply;
+}
+
+auto Session_service::sync_world(std::uint64_t baseline_tick) -> Event
+{
+  auto const &now{_world_history.at(
+      _server->_tick, [this] { return _server->_game_map.to_char_matrix(); })};
+  auto const *const baseline{_world_history.find(baseline_tick)};
+
+  Event e{"ok"};
+  e.set_param("tick", now.tick);
+  // `0` tells the client that this is a full snapshot, replacing what it knows.
+  e.set_param("baseline", baseline != nullptr ? baseline->tick : 0);
+
+  // The players are read as they are, not as of `now`. Changes made since
+  // `now` was taken are then sent again by the next delta, which is harmless.
+  // Without a baseline, every field is sent, as all changed after version `0`.
+  auto const since{baseline != nullptr ? baseline->player_version : 0};
+  auto players = json::array();
+  for (auto const &player : _server->_players.players()) {
+    auto const mask{player.fields_changed_since(since)};
+    if (mask != 0) {
+      players.push_back({{"name", player.name()},
+                         {"mask", mask},
+                         {"fields", delta::fields_to_json(player, mask)}});
     }
-    auto const &game{
-        _server->allocate_game({_server->_players[player_name].get(),
-                                _server->_players[target].get()})};
-    Event battle{"battle"s};
-    battle.set_param("from", player_name);
-    push_event(target, battle);
-    Event e{"ok"s};
-    e.set_param("game-id", game.id());
+  }
+  e.set_param("players", std::move(players));
+
+  if (baseline == nullptr) {
+    e.set_param("map", now.map);
     return e;
   }
-  if (command.name() == "buy") {
-    auto const item_name{command.get_arg<std::string>(0)};
-    auto const &item{_server->_store_items[item_name]};
-    if (player->money() < item.price) {
-      Event e{"error"};
-      e.add_arg("You don't have enough money to buy this item!");
-      return e;
-    }
-    player->cost_money(item.price);
-    // item.effect;
-    // TODO(shelpam): now only provides one goods, so not using flexible way to
-    // achieve the effect.
-    if (item.name == "First aid kit") {
-      player->heal(10);
-      Event cure{"cure"};
-      cure.add_arg(10);
-      cure.set_param("cause",
-                     "You bought First aid kit, health increase by 10");
-      push_event(player_name, cure);
+
+  auto removed = json::array();
+  for (auto const &name : _world_history.removed_since(*baseline)) {
+    removed.push_back(name);
+  }
+  e.set_param("removed", std::move(removed));
+
+  // The size of the map never changes.
+  auto cells = json::array();
+  for (std::size_t row{}; row != now.map.size(); ++row) {
+    for (std::size_t col{}; col != now.map[row].size(); ++col) {
+      if (now.map[row][col] != baseline->map[row][col]) {
+        cells.push_back({row, col, now.map[row][col]});
+      }
     }
-    return Event{"ok"};
   }
-  if (command.name() == "get-game-map") {
-    Event e{"ok"};
-    e.add_arg(_server->_game_map);
-    return e;
+  e.set_param("cells", std::move(cells));
+  return e;
+}
+
+void Session_service::on_received(Session_ptr const &session, Packet packet)
+{
+  _received.push(Received{.session = session, .packet = std::move(packet)});
+}
+
+void Session_service::on_closed(Session_ptr const &session)
+{
+  _closed.push(session);
+}
+
+void Session_service::bind(Session &session, std::string const &name)
+{
+  std::ignore = unbind(session);
+  auto const player{_server->login(name)};
+  session.identity(Session_identity{.username = name, .player_handle = player});
+  _bound_sessions[player].push_back(session.weak_from_this());
+}
+
+auto Session_service::unbind(Session &session) -> std::optional<Player_handle>
+{
+  auto const *identity{session.identity()};
+  if (identity == nullptr) {
+    return std::nullopt;
   }
-  if (command.name() == "list-store-items") {
-    Event e{"ok"};
-    e.add_arg(_server->_store_items);
-    return e;
+  auto const player{identity->player_handle};
+  session.identity(std::nullopt);
+
+  auto const it{_bound_sessions.find(player)};
+  if (it == _bound_sessions.end()) {
+    return std::nullopt;
+  }
+  std::erase_if(it->second, [&session](auto const &bound) {
+    auto const locked{bound.lock()};
+    return locked == nullptr || locked.get() == &session;
+  });
+  if (!it->second.empty()) {
+    return std::nullopt;
+  }
+  _bound_sessions.erase(it);
+  return player;
+}
+
+void Session_service::release(Player_handle player)
+{
+  if (auto const *const removed{_server->player(player)}) {
+    _world_history.record_removal(removed->name());
+  }
+  // First, as ending the battles of the player may push events to it.
+  _server->remove_player(player);
+  _subscribers.erase(player);
+  _events.erase(player);
+}
+
+void Session_service::log_out(Session &session)
+{
+  auto const *const identity{session.identity()};
+  if (identity == nullptr) {
+    return;
   }
-  if (command.name() == "list-players") {
-    Event e{"ok"};
-    // Converts players.
-    std::vector<Player> players;
-    players.reserve(_server->_players.size());
-    for (auto const &[_, p] : _server->_players) {
-      players.push_back(*p);
+  auto const player{identity->player_handle};
+  // Otherwise, the other sessions would keep an identity whose player is gone.
+  if (auto const it{_bound_sessions.find(player)};
+      it != _bound_sessions.end()) {
+    for (auto const &bound : it->second) {
+      if (auto const other{bound.lock()}) {
+        other->identity(std::nullopt);
+      }
     }
-    e.add_arg(std::move(players));
-    return e;
+    _bound_sessions.erase(it);
   }
-  if (command.name() == "query-event") {
-    if (_events[player_name].empty()) {
-      push_event(player_name, Event("none"s));
+  session.identity(std::nullopt);
+  release(player);
+}
+
+void Session_service::handle_received()
+{
+  while (auto received{_received.try_pop()}) {
+    auto &[session, packet]{*received};
+    // The close of the session may be handled already, and binding it again
+    // would leak its player.
+    if (session->closed()) {
+      continue;
     }
-    return pop_event(player_name);
+    auto const id{packet.id};
+    auto reply{[this, &session, &packet] {
+      // A malformed packet must not take the whole server down.
+      try {
+        return on_reading_packet(session, std::move(packet));
+      }
+      catch (std::exception const &e) {
+        spdlog::warn("Failed to handle a packet: {}", e.what());
+        return error_reply(std::format("Bad request: {}", e.what()));
+      }
+    }()};
+    reply.id = id;
+    session->send(std::move(reply));
   }
-  if (command.name() == "sync") {
-    Event e{"ok"};
-    e.add_arg(*player);
-    return e;
+
+  // After the packets, as those of a closed session may still be queued.
+  while (auto closed{_closed.try_pop()}) {
+    if (auto const player{unbind(**closed)}) {
+      if (auto const *const p{_server->player(*player)}) {
+        spdlog::info("{} disconnected.", p->name());
+      }
+      release(*player);
+    }
+  }
+}
+
+auto Session_service::on_reading_packet(Session_ptr const &session,
+                                        Packet packet) -> Packet
+{
+  if (packet.protocol != Packet::this_protocol_name) {
+    spdlog::warn("Packet protocol is different from ours: {}", packet.protocol);
+    return error_reply(std::format("Protocol error: {} used.", packet.protocol));
   }
 
-  if (_server->_server_commands.contains(command.name())) {
-    return _server->_server_commands.at(command.name())
-        ->execute(player_name, command);
+  // Binds the session to the player on its first authenticated packet, so
+  // that later packets can omit the sender, and we don't have to verify and
+  // look the player up again for each of them.
+  auto *identity{session->identity()};
+  if (identity == nullptr ||
+      _server->player(identity->player_handle) == nullptr) {
+    if (!packet.sender || !_server->verify_userinfo(*packet.sender)) {
+      return error_reply("Wrong username or password.");
+    }
+    if (packet.sender->username().size() > User_info::max_username_size) {
+      return error_reply(std::format("Usernames are limited to {} bytes.",
+                                     User_info::max_username_size));
+    }
+    bind(*session, packet.sender->username());
+    identity = session->identity();
   }
 
-  auto const error_msg{
-      std::format("Unrecognized command \"{}\"", command.name())};
-  spdlog::warn(error_msg);
-  Event error{"error"};
-  error.add_arg(error_msg);
-  return error;
+  // TODO(shelpam): We must consider sign-ups, but for now just ignore it.
+  Command const player_command{std::move(packet.payload)};
+  spdlog::debug("Received command: {}", player_command.dump());
+
+  auto const opcode{player_command.opcode()};
+  auto *const executor{opcode ? _server->command_executor(*opcode)
+                              : nullptr};
+  if (executor == nullptr) {
+    auto const error_msg{
+        std::format("Unrecognized command \"{}\"", player_command.name())};
+    spdlog::warn(error_msg);
+    return error_reply(error_msg);
+  }
+  return executor
+      ->execute(Command_context{.session = session, .identity = *identity},
+                player_command)
+      .into_packet();
 }
@@ -1,36 +1,142 @@
 #pragma once
 
 #include "command.h"
+#include "lock-free-queue.h"
+#include "packet.h"
 #include "server/session-repository.h"
+#include "server/shared-event.h"
+#include "server/snapshot-cache.h"
+#include "server/world-history.h"
 #include <event.h>
 #include <map>
 #include <queue>
+#include <unordered_map>
+#include <vector>
 
 class Command;
 class Server;
+struct Session_identity;
+class Query_event_server_command_executor;
+
+namespace server_command_executors {
+class Login;
+class Logout;
+class List_store_items;
+class Subscribe_events;
+class Sync_world;
+class List_players;
+class Get_game_map;
+} // namespace server_command_executors
 
 // Controls all stuff related to sending/receiving packets, ensuring that the
 // packets arrive at destination without coalescing.
+//
+// Packets are read on the network threads, and handed over to the simulation
+// thread, which is the only one touching the game state, through a lock-free
+// queue. Replies and events go back through the outbox of each session.
+// Everything below runs on the simulation thread unless noted otherwise.
 class Session_service {
+  friend class Query_event_server_command_executor;
+  friend class server_command_executors::Login;
+  friend class server_command_executors::Logout;
+  friend class server_command_executors::List_store_items;
+  friend class server_command_executors::Subscribe_events;
+  friend class server_command_executors::Sync_world;
+  friend class server_command_executors::List_players;
+  friend class server_command_executors::Get_game_map;
+
+  struct Received {
+    Session_ptr session;
+    Packet packet;
+  };
+
 public:
-  Session_service(Server *server, std::uint16_t port, std::string name);
+  Session_service(Server *server, std::uint16_t port, Session_limits limits,
+                  std::size_t max_queued_events, std::string name);
   void start();
   void stop();
 
-  void push_event(std::string const &player, Event event);
-  void push_event_all(Event const &event);
-  auto pop_event(std::string const &player) -> Event;
+  // Handles every packet received since last call, and replies to them. Then
+  // releases what is kept for the sessions closed since last call.
+  void handle_received();
+
+  // Sends `event` to `player` right away if the player has subscribed to
+  // events, or queues it until the player queries it otherwise. At most
+  // `max_queued_events` are queued for a player, dropping the oldest ones.
+  void push_event(Player_handle player, Event event);
+  // Same as above, but `event` may be pushed to other players too, sharing
+  // its serialization with them.
+  void push_event(Player_handle player, Shared_event_ptr const &event);
+  void push_event_all(Event event);
 
 private:
-  auto on_reading_packet(Packet packet) -> Packet;
+  // Called on the strand of `session`.
+  void on_received(Session_ptr const &session, Packet packet);
+  void on_closed(Session_ptr const &session);
+
+  // Binds `session` to the player of `name`, logging the player in.
+  void bind(Session &session, std::string const &name);
+  // Unbinds `session` from its player, if bound.
+  //
+  // @return
+  //  The handle of the player if no other session is bound to it.
+  auto unbind(Session &session) -> std::optional<Player_handle>;
+  // Removes `player`, and the events queued for it.
+  void release(Player_handle player);
+  // Unbinds every session bound to the player of `session`, and releases the
+  // player. The other sessions must log in again, like `session`.
+  void log_out(Session &session);
+  auto on_reading_packet(Session_ptr const &session, Packet packet) -> Packet;
 
+  // Pushes events to `session` from now on, starting with the queued ones.
+  void subscribe(Player_handle player, Session_ptr const &session);
+  // The session subscribed to the events of `player`, if any is still open.
+  auto subscriber(Player_handle player) -> Session_ptr;
+  void send_event(Session &session, Shared_event const &event) const;
+  // Kept for clients that don't subscribe to events.
+  //
   // @return
-  //  Result_type
-  auto handle_command(std::string const &player, Command const &command)
-      -> Event;
+  //  The reply carrying the oldest event queued for `player`.
+  auto query_event_reply(Player_handle player, Session const &session)
+      -> Packet;
+
+  // The reply holding `snapshot` of the current tick, encoded for `session`.
+  [[nodiscard]] auto snapshot_reply(Snapshot snapshot, Session const &session)
+      -> Packet;
+
+  // @return
+  //  The changes of the world since the snapshot of `baseline_tick`, or the
+  //  whole world if that snapshot is unknown.
+  auto sync_world(std::uint64_t baseline_tick) -> Event;
+
+  // Adds game state to a reply, packed by the binary codec if `session` speaks
+  // a binary encoding, saving building and encoding the json of it.
+  template <typename T>
+  static void add_state_arg(Event &e, Session const &session, T const &state);
 
   Server *_server;
   Session_repository _session_repo;
-  std::map<std::string, std::queue<Event>> _events;
+  std::size_t _max_queued_events;
+  std::unordered_map<Player_handle, std::queue<Shared_event_ptr>> _events;
+  std::unordered_map<Player_handle, std::weak_ptr<Session>> _subscribers;
+  Mpsc_queue<Received> _received;
+  Mpsc_queue<Session_ptr> _closed;
+  // Sessions bound to each player.
+  std::unordered_map<Player_handle, std::vector<std::weak_ptr<Session>>>
+      _bound_sessions;
+  Snapshot_cache _snapshots;
+  World_history _world_history;
   std::string _name;
 };
+
+template <typename T>
+void Session_service::add_state_arg(Event &e, Session const &session,
+                                    T const &state)
+{
+  if (session.encoding() == codec::Encoding::json) {
+    e.add_arg(state);
+  }
+  else {
+    e.add_packed_arg(state);
+  }
+}
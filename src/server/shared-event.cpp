@@ -0,0 +1,19 @@
+#include "shared-event.h"
+
+Shared_event::Shared_event(Event event) : _event{std::move(event)} {}
+
+auto Shared_event::event() const -> Event const &
+{
+  return _event;
+}
+
+auto Shared_event::encoded(codec::Encoding encoding) const -> Buffer
+{
+  auto &buffer{_encoded[static_cast<std::size_t>(encoding)]};
+  if (buffer == nullptr) {
+    auto bytes{std::make_shared<std::string>()};
+    codec::encode_to(json(_event), encoding, *bytes);
+    buffer = std::move(bytes);
+  }
+  return buffer;
+}
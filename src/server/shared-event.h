@@ -0,0 +1,32 @@
+#pragma once
+
+#include "codec.h"
+#include "event.h"
+#include <array>
+#include <memory>
+#include <string>
+
+// An event that may be pushed to many players, such as a chat message. It is
+// immutable, so that every queue and packet can share it, and is serialized
+// at most once for each encoding it's sent in, however many players get it.
+// Must only be used on the simulation thread.
+class Shared_event {
+public:
+  using Buffer = std::shared_ptr<std::string const>;
+
+  explicit Shared_event(Event event);
+
+  [[nodiscard]] auto event() const -> Event const &;
+
+  // @return
+  //  The payload of packets carrying the event, in `encoding`.
+  [[nodiscard]] auto encoded(codec::Encoding encoding) const -> Buffer;
+
+private:
+  static constexpr std::size_t encodings{3};
+
+  Event _event;
+  mutable std::array<Buffer, encodings> _encoded;
+};
+
+using Shared_event_ptr = std::shared_ptr<Shared_event const>;
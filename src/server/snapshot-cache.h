@@ -0,0 +1,50 @@
+#pragma once
+
+#include "codec.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Replies describing the world as a whole, which are the same for every
+// player.
+enum class Snapshot : std::uint8_t {
+  players,
+  game_map,
+};
+
+// Keeps the encoded snapshots of the current tick, so that each of them is
+// serialized at most once per tick and encoding, however many players ask for
+// it. The buffers are immutable, and shared by all the packets sending them.
+class Snapshot_cache {
+public:
+  using Buffer = std::shared_ptr<std::string const>;
+
+  // @return
+  //  The `snapshot` of `tick` in `encoding`. If it isn't cached yet, it's
+  //  written by `make(out)` and cached until a later tick.
+  template <typename Make>
+  [[nodiscard]] auto get(std::uint64_t tick, Snapshot snapshot,
+                         codec::Encoding encoding, Make &&make) -> Buffer
+  {
+    auto &entry{_entries[static_cast<std::size_t>(snapshot) * encodings +
+                         static_cast<std::size_t>(encoding)]};
+    if (entry.buffer == nullptr || entry.tick != tick) {
+      auto buffer{std::make_shared<std::string>()};
+      make(*buffer);
+      entry = Entry{.tick = tick, .buffer = std::move(buffer)};
+    }
+    return entry.buffer;
+  }
+
+private:
+  static constexpr std::size_t snapshots{2};
+  static constexpr std::size_t encodings{3};
+
+  struct Entry {
+    std::uint64_t tick;
+    Buffer buffer;
+  };
+
+  std::array<Entry, snapshots * encodings> _entries{};
+};
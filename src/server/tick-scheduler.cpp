@@ -0,0 +1,47 @@
+#include "tick-scheduler.h"
+#include <spdlog/spdlog.h>
+
+Tick_scheduler::Tick_scheduler(Duration interval, std::size_t max_catch_up,
+                               Clock::time_point start)
+    : _interval{interval}, _max_catch_up{max_catch_up}, _last{start}
+{
+}
+
+auto Tick_scheduler::begin(Clock::time_point now) -> std::size_t
+{
+  _accumulated += now - _last;
+  _last = now;
+
+  auto ticks{static_cast<std::uint64_t>(_accumulated / _interval)};
+  _accumulated -= ticks * _interval;
+  if (ticks > _max_catch_up) {
+    spdlog::warn("Simulation fell {} ticks behind, dropping {} of them.",
+                 ticks, ticks - _max_catch_up);
+    _stats.missed += ticks - _max_catch_up;
+    ticks = _max_catch_up;
+  }
+  _stats.ticks += ticks;
+  return ticks;
+}
+
+void Tick_scheduler::end(Clock::time_point now)
+{
+  if (now - _last > _interval) {
+    ++_stats.overruns;
+  }
+}
+
+auto Tick_scheduler::interval() const -> Duration
+{
+  return _interval;
+}
+
+auto Tick_scheduler::next_tick() const -> Clock::time_point
+{
+  return _last + (_interval - _accumulated);
+}
+
+auto Tick_scheduler::stats() const -> Stats const &
+{
+  return _stats;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "chrono.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Runs the simulation at a fixed rate, whatever the load. Time is accumulated
+// as it passes and spent by whole ticks of `interval`, so every tick simulates
+// the same duration. After a stall, at most `max_catch_up` ticks are run at
+// once, and the time beyond them is dropped.
+class Tick_scheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Stats {
+    std::uint64_t ticks;
+    // Ticks dropped by the catch-up limit.
+    std::uint64_t missed;
+    // Iterations whose work took longer than a tick.
+    std::uint64_t overruns;
+  };
+
+  Tick_scheduler(Duration interval, std::size_t max_catch_up,
+                 Clock::time_point start);
+
+  // Starts an iteration of the loop at `now`.
+  //
+  // @return
+  //  The number of ticks to run.
+  auto begin(Clock::time_point now) -> std::size_t;
+  // Ends the iteration started by the last `begin`, at `now`.
+  void end(Clock::time_point now);
+
+  // The time each tick simulates.
+  [[nodiscard]] auto interval() const -> Duration;
+  // When the next tick is due, to sleep until then.
+  [[nodiscard]] auto next_tick() const -> Clock::time_point;
+  [[nodiscard]] auto stats() const -> Stats const &;
+
+private:
+  Duration _interval;
+  std::size_t _max_catch_up;
+  Clock::time_point _last;
+  // Time passed but not simulated yet, less than `_interval` between
+  // iterations.
+  Duration _accumulated{};
+  Stats _stats{};
+};
@@ -0,0 +1,163 @@
+#include "udp-channel.h"
+#include "player.h"
+#include "server.h"
+#include <spdlog/spdlog.h>
+
+Udp_channel::Udp_channel(Server *server, asio::io_context &io_context,
+                         std::uint16_t port, float loss_rate)
+    : _server{server}, _strand{asio::make_strand(io_context)},
+      _socket{_strand, udp::endpoint{udp::v4(), port}},
+      _port{_socket.local_endpoint().port()}, _loss{loss_rate}
+{
+}
+
+void Udp_channel::start()
+{
+  asio::dispatch(_strand, [this] { do_receive(); });
+}
+
+void Udp_channel::stop()
+{
+  asio::dispatch(_strand, [this] { _socket.close(); });
+}
+
+auto Udp_channel::port() const -> std::uint16_t
+{
+  return _port;
+}
+
+auto Udp_channel::open(Player_handle player, Session_ptr const &session)
+    -> std::uint64_t
+{
+  // Opened once per client, so looking through the peers is cheap enough.
+  // Peers of closed sessions go too.
+  std::erase_if(_peers, [&session](auto const &entry) {
+    auto const bound{entry.second.session.lock()};
+    return bound == nullptr || bound == session;
+  });
+
+  std::uint64_t token{};
+  do {
+    token = _token_generator();
+  } while (token == 0 || _peers.contains(token));
+  _peers.emplace(token, Peer{.player = player,
+                             .session = session,
+                             .endpoint{},
+                             .received{},
+                             .last_sent{}});
+  return token;
+}
+
+void Udp_channel::handle_received()
+{
+  while (auto received{_received.try_pop()}) {
+    if (_loss.should_drop()) {
+      continue;
+    }
+
+    binary_codec::Reader reader{received->bytes};
+    auto const header{datagram::read_header(reader)};
+    if (!header) {
+      continue;
+    }
+    auto const it{_peers.find(header->token)};
+    if (it == _peers.end()) {
+      continue;
+    }
+    auto &peer{it->second};
+    if (peer.session.expired()) {
+      _peers.erase(it);
+      continue;
+    }
+    if (!peer.received.accept(header->sequence)) {
+      spdlog::debug("Dropping stale datagram {}", header->sequence);
+      continue;
+    }
+    peer.endpoint = received->from;
+
+    try {
+      switch (header->type) {
+      case datagram::Type::move: {
+        datagram::Move move;
+        reader.read(move);
+        if (auto *const player{_server->player(peer.player)}) {
+          player->move_direction(move.direction);
+        }
+        break;
+      }
+      default:
+        spdlog::debug("Unexpected datagram type {}",
+                      static_cast<int>(header->type));
+        break;
+      }
+    }
+    catch (std::runtime_error const &e) {
+      spdlog::debug("Dropping malformed datagram: {}", e.what());
+    }
+  }
+}
+
+void Udp_channel::send_positions()
+{
+  for (auto it{_peers.begin()}; it != _peers.end();) {
+    auto &[token, peer]{*it};
+    if (peer.session.expired()) {
+      it = _peers.erase(it);
+      continue;
+    }
+    auto const *const viewer{_server->player(peer.player)};
+    if (viewer == nullptr || !peer.endpoint) {
+      ++it;
+      continue;
+    }
+
+    datagram::Positions positions;
+    datagram::fill_positions(positions, *viewer, _server->_players.players());
+
+    send(*peer.endpoint,
+         datagram::encode(datagram::Header{.token = token,
+                                           .sequence = ++peer.last_sent,
+                                           .type = datagram::Type::positions},
+                          positions));
+    ++it;
+  }
+}
+
+void Udp_channel::do_receive()
+{
+  _socket.async_receive_from(
+      asio::buffer(_receive_buf), _receive_from,
+      [this](std::error_code ec, std::size_t length) {
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
+        if (ec) {
+          spdlog::warn("Error occurred while receiving datagram: {}",
+                       ec.message());
+        }
+        else {
+          _received.push(Received{
+              .from = _receive_from,
+              .bytes{_receive_buf.begin(), _receive_buf.begin() + length}});
+        }
+        do_receive();
+      });
+}
+
+void Udp_channel::send(udp::endpoint const &to, binary_codec::Bytes datagram)
+{
+  if (_loss.should_drop()) {
+    return;
+  }
+  asio::post(_strand, [this, to,
+                       datagram{std::make_shared<binary_codec::Bytes>(
+                           std::move(datagram))}] {
+    _socket.async_send_to(asio::buffer(*datagram), to,
+                          [datagram](std::error_code ec, std::size_t) {
+                            if (ec) {
+                              spdlog::debug("Failed to send datagram: {}",
+                                            ec.message());
+                            }
+                          });
+  });
+}
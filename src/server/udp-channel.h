@@ -0,0 +1,75 @@
+#pragma once
+
+#include "datagram.h"
+#include "lock-free-queue.h"
+#include "player-fwd.h"
+#include "session_fwd.h"
+#include <array>
+#include <asio.hpp>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <unordered_map>
+
+using asio::ip::udp;
+class Server;
+
+// The server side of the datagram channel. Datagrams are received on the
+// network threads and handed to the simulation thread, like packets of
+// sessions. Everything below runs on the simulation thread unless noted
+// otherwise.
+class Udp_channel {
+public:
+  // @param loss_rate Probability of dropping each datagram, in and out.
+  Udp_channel(Server *server, asio::io_context &io_context, std::uint16_t port,
+              float loss_rate);
+  void start();
+  void stop();
+
+  [[nodiscard]] auto port() const -> std::uint16_t;
+
+  // Binds a new token to `session`, whose player is `player`. Datagrams with
+  // the token are dropped once the session is gone. The token bound to the
+  // session before is revoked, so that reopening doesn't grow the peers.
+  //
+  // @return
+  //  The token.
+  [[nodiscard]] auto open(Player_handle player, Session_ptr const &session)
+      -> std::uint64_t;
+
+  // Applies the movement received since last call.
+  void handle_received();
+
+  // Sends each client the positions of the players it can see.
+  void send_positions();
+
+private:
+  struct Received {
+    udp::endpoint from;
+    binary_codec::Bytes bytes;
+  };
+
+  struct Peer {
+    Player_handle player;
+    std::weak_ptr<Session> session;
+    // Learnt from the datagrams of the client.
+    std::optional<udp::endpoint> endpoint;
+    datagram::Sequence_filter received;
+    std::uint32_t last_sent{};
+  };
+
+  // Called on the strand.
+  void do_receive();
+  void send(udp::endpoint const &to, binary_codec::Bytes datagram);
+
+  Server *_server;
+  asio::strand<asio::io_context::executor_type> _strand;
+  udp::socket _socket;
+  std::uint16_t _port;
+  std::array<std::uint8_t, datagram::max_size> _receive_buf{};
+  udp::endpoint _receive_from;
+  Mpsc_queue<Received> _received;
+  std::unordered_map<std::uint64_t, Peer> _peers;
+  datagram::Loss_injector _loss;
+  std::mt19937_64 _token_generator{std::random_device{}()};
+};
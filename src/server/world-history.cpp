@@ -0,0 +1,36 @@
+#include "world-history.h"
+#include <algorithm>
+
+auto World_history::find(std::uint64_t tick) const -> World_snapshot const *
+{
+  auto const it{std::ranges::lower_bound(_snapshots, tick, {},
+                                         &World_snapshot::tick)};
+  return it != _snapshots.end() && it->tick == tick ? &*it : nullptr;
+}
+
+void World_history::record_removal(std::string name)
+{
+  ++_removed_count;
+  // No snapshot to tell it to.
+  if (_snapshots.empty()) {
+    return;
+  }
+  _removed.push_back(std::move(name));
+}
+
+auto World_history::removed_since(World_snapshot const &snapshot) const
+    -> std::span<std::string const>
+{
+  auto const first_kept{_removed_count - _removed.size()};
+  return std::span{_removed}.subspan(snapshot.removed_count - first_kept);
+}
+
+void World_history::forget_removals()
+{
+  auto const first_kept{_removed_count - _removed.size()};
+  auto const forgotten{_snapshots.empty()
+                           ? _removed.size()
+                           : _snapshots.front().removed_count - first_kept};
+  _removed.erase(_removed.begin(),
+                 _removed.begin() + static_cast<std::ptrdiff_t>(forgotten));
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "player.h"
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <string>
+#include <vector>
+
+// The world as sent to clients, as of a tick. Players aren't copied: the
+// fields changed since are those of versions after `player_version`.
+struct World_snapshot {
+  std::uint64_t tick;
+  // `Player::latest_version()` when the snapshot was taken.
+  std::uint64_t player_version;
+  // Number of players removed before the snapshot was taken.
+  std::uint64_t removed_count;
+  std::vector<std::vector<char>> map;
+};
+
+// Keeps the world snapshots of recent ticks, which serve as the baselines of
+// the deltas sent to clients. A client acknowledges a snapshot by asking for
+// the delta since it; clients asking with a forgotten baseline get a full
+// snapshot instead.
+class World_history {
+public:
+  // @return
+  //  The snapshot of `tick`, taken with the map returned by `take_map()` if it
+  //  isn't yet.
+  template <typename Take_map>
+  auto at(std::uint64_t tick, Take_map &&take_map) -> World_snapshot const &
+  {
+    if (_snapshots.empty() || _snapshots.back().tick != tick) {
+      if (_snapshots.size() == max_snapshots) {
+        _snapshots.pop_front();
+        forget_removals();
+      }
+      _snapshots.push_back(World_snapshot{.tick = tick,
+                                          .player_version =
+                                              Player::latest_version(),
+                                          .removed_count = _removed_count,
+                                          .map = take_map()});
+    }
+    return _snapshots.back();
+  }
+
+  // @return
+  //  The snapshot of `tick`, or `nullptr` if it's forgotten or never taken.
+  [[nodiscard]] auto find(std::uint64_t tick) const -> World_snapshot const *;
+
+  // Records that the player of `name` is removed, for the deltas since the
+  // snapshots taken before.
+  void record_removal(std::string name);
+
+  // @return
+  //  The names of the players removed after `snapshot` was taken, in order.
+  //  Players added and removed since are named too.
+  [[nodiscard]] auto removed_since(World_snapshot const &snapshot) const
+      -> std::span<std::string const>;
+
+private:
+  // Forgets the removals before every snapshot kept.
+  void forget_removals();
+
+  // Snapshots are taken only on ticks when some client syncs, so this covers
+  // 6.4 seconds at least at 10 ticks per second. A snapshot holds no player,
+  // and the map is small, so keeping them is cheap.
+  static constexpr std::size_t max_snapshots{64};
+
+  std::deque<World_snapshot> _snapshots;
+  // Names of the players removed since the oldest snapshot.
+  std::vector<std::string> _removed;
+  // Number of players ever removed, of which `_removed` are the last ones.
+  std::uint64_t _removed_count{};
+};
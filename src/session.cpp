@@ -1,124 +1,722 @@
 #include "session.h"
+#include "buffer-pool.h"
+#include <algorithm>
+#include <array>
 #include <source_location>
+#include <span>
 
-Session::Session(tcp::socket socket) : _socket{std::move(socket)} {}
+namespace {
+
+// Returns whether the read failed. Do not throw exception because client can
+// construct a malformed package, or just not responding to us. Throwing
+// exception can cause server stop.
+auto read_failed(std::error_code ec) -> bool
+{
+  if (ec == asio::error::eof) {
+    return true;
+  }
+  if (ec) {
+    spdlog::warn("Error occurred while reading from session: {}, closing "
+                 "this session.",
+                 ec.message());
+    return true;
+  }
+  return false;
+}
+
+// Makes the operation completing with `handler` allocate its state from
+// `memory`, as asio allocates with the allocator associated with the handler.
+template <typename F> class Recycling_handler {
+public:
+  using allocator_type = Handler_allocator<F>;
+
+  Recycling_handler(Handler_memory &memory, F handler)
+      : _memory{&memory}, _handler{std::move(handler)}
+  {
+  }
+
+  [[nodiscard]] auto get_allocator() const noexcept -> allocator_type
+  {
+    return allocator_type{*_memory};
+  }
+
+  template <typename... Args> void operator()(Args &&...args)
+  {
+    _handler(std::forward<Args>(args)...);
+  }
+
+private:
+  Handler_memory *_memory;
+  F _handler;
+};
+
+template <typename F> auto recycling(Handler_memory &memory, F handler)
+{
+  return Recycling_handler<F>{memory, std::move(handler)};
+}
+
+} // namespace
+
+Session::Session(tcp::socket socket, frame::Handshake handshake,
+                 Session_limits limits)
+    : _socket{std::move(socket)}, _framing{handshake.framing},
+      _encoding{handshake.encoding}, _limits{limits},
+      _deadline{_socket.get_executor()}
+{
+}
+
+Session::~Session()
+{
+  Buffer_pool::instance().release(std::move(_read_buf));
+}
 
 void Session::schedule_request(Packet packet,
-                               std::function<void(Packet)> on_replied)
+                               Packet_handler on_replied)
 {
   spdlog::trace("Call {}", std::source_location::current().function_name());
 
-  schedule_write(std::move(packet), [self{shared_from_this()},
-                                     on_read{std::move(on_replied)}]() mutable {
-    self->schedule_read(std::move(on_read));
+  asio::dispatch(_socket.get_executor(),
+                 [self{shared_from_this()}, packet{std::move(packet)},
+                  on_replied{std::move(on_replied)}]() mutable {
+                   if (self->_closed) {
+                     return;
+                   }
+                   packet.id = ++self->_last_request_id;
+                   self->_outstanding_requests.emplace(packet.id,
+                                                       std::move(on_replied));
+                   self->push_write(
+                       Write{.packet{std::move(packet)}, .post_write{[] {}}});
+
+                   // Keeps reading until the reply arrives.
+                   self->deliver_read_packets();
+                 });
+}
+
+void Session::schedule_read(Packet_handler on_read)
+{
+  asio::dispatch(_socket.get_executor(), [self{shared_from_this()},
+                                          on_read{std::move(on_read)}]() mutable {
+    self->push_read(Read{.on_read{std::move(on_read)}, .on_read_batch{}});
+  });
+}
+
+void Session::schedule_read_batch(
+    Batch_handler on_read)
+{
+  asio::dispatch(_socket.get_executor(), [self{shared_from_this()},
+                                          on_read{std::move(on_read)}]() mutable {
+    self->push_read(Read{.on_read{}, .on_read_batch{std::move(on_read)}});
   });
 }
 
-void Session::schedule_read(std::function<void(Packet)> on_read)
+void Session::handle_pushes(Packet_handler on_push)
 {
-  auto const read_not_in_progress{_pending_reads.empty()};
+  asio::dispatch(_socket.get_executor(), [self{shared_from_this()},
+                                          on_push{std::move(on_push)}]() mutable {
+    if (self->_closed) {
+      return;
+    }
+    self->_on_push = std::move(on_push);
+    self->deliver_read_packets();
+  });
+}
 
-  _pending_reads.push(std::move(on_read));
+void Session::schedule_write(Packet packet, Handler post_write)
+{
+  asio::dispatch(_socket.get_executor(),
+                 [self{shared_from_this()}, packet{std::move(packet)},
+                  post_write{std::move(post_write)}]() mutable {
+                   self->push_write(Write{.packet{std::move(packet)},
+                                          .post_write{std::move(post_write)}});
+                 });
+}
 
-  if (read_not_in_progress) {
-    do_async_read();
+void Session::send(Packet packet, Coalescing coalescing)
+{
+  _outbox.push(Write{.packet{std::move(packet)},
+                     .post_write{[] {}},
+                     .coalescing = coalescing});
+
+  // Only one flush is posted for a burst of packets. It is the only allocation
+  // of a burst whose payloads are encoded already: posting through the
+  // type-erased executor of the socket ignores the allocator of the handler,
+  // and asio recycles the memory of handlers only on the threads running the
+  // `io_context`, which this one isn't.
+  if (!_outbox_flush_scheduled.exchange(true, std::memory_order_acq_rel)) {
+    asio::post(_socket.get_executor(),
+               [self{shared_from_this()}] { self->flush_outbox(); });
+  }
+}
+
+auto Session::identity() const -> Session_identity const *
+{
+  return _identity ? &*_identity : nullptr;
+}
+
+auto Session::identity() -> Session_identity *
+{
+  return _identity ? &*_identity : nullptr;
+}
+
+void Session::identity(std::optional<Session_identity> identity)
+{
+  _identity = std::move(identity);
+}
+
+auto Session::encoding() const -> codec::Encoding
+{
+  return _encoding;
+}
+
+void Session::on_close(Handler handler)
+{
+  asio::dispatch(_socket.get_executor(), [self{shared_from_this()},
+                                          handler{std::move(handler)}]() mutable {
+    if (self->_closed) {
+      handler();
+      return;
+    }
+    self->_on_close = std::move(handler);
+  });
+}
+
+void Session::push_read(Read read)
+{
+  // Nothing will be read anymore.
+  if (_closed) {
+    return;
+  }
+  _pending_reads.push(std::move(read));
+
+  // Packets may have arrived before anyone asked for them.
+  deliver_read_packets();
+}
+
+void Session::push_write(Write write)
+{
+  if (enqueue_write(std::move(write)) && _writing.empty()) {
+    do_async_write();
   }
 }
 
-void Session::schedule_write(Packet packet, std::function<void()> post_write)
+auto Session::enqueue_write(Write write) -> bool
 {
-  auto const write_not_in_progress{_pending_writes.empty()};
+  if (_closed) {
+    return false;
+  }
+  if (coalesce(write)) {
+    return true;
+  }
+
+  serialize(write);
+  _queued_bytes += write.size();
+  _pending_writes.push_back(std::move(write));
 
-  _pending_writes.emplace(std::move(packet), std::move(post_write));
+  auto const queued_packets{_pending_writes.size() + _writing.size()};
+  if (queued_packets > _limits.max_queued_packets ||
+      _queued_bytes > _limits.max_queued_bytes) {
+    spdlog::warn("Peer doesn't keep up with {} packets ({} bytes) queued, "
+                 "closing this session.",
+                 queued_packets, _queued_bytes);
+    close();
+    return false;
+  }
+  return true;
+}
 
-  if (write_not_in_progress) {
+auto Session::coalesce(Write &write) -> bool
+{
+  if (write.coalescing.key == 0) {
+    return false;
+  }
+
+  for (auto it{_pending_writes.rbegin()};
+       it != _pending_writes.rend() && it->coalescing.key != 0; ++it) {
+    if (it->coalescing.key != write.coalescing.key ||
+        !write.coalescing.merge(it->packet, write.packet)) {
+      continue;
+    }
+    _queued_bytes -= it->size();
+    serialize(*it);
+    _queued_bytes += it->size();
+    return true;
+  }
+  return false;
+}
+
+auto Session::is_outstanding_reply(Packet const &packet) const -> bool
+{
+  return packet.id != 0 && _outstanding_requests.contains(packet.id);
+}
+
+auto Session::take_read_packet() -> Packet
+{
+  auto packet{std::move(_read_packets[_next_read_packet++])};
+  if (_next_read_packet == _read_packets.size()) {
+    _read_packets.clear();
+    _next_read_packet = 0;
+  }
+  return packet;
+}
+
+void Session::flush_outbox()
+{
+  // Clears the flag first, so that packets sent from now on post another
+  // flush, even if they are already taken by this one.
+  _outbox_flush_scheduled.store(false, std::memory_order_release);
+
+  auto const write_in_progress{!_writing.empty()};
+  while (auto write{_outbox.try_pop()}) {
+    if (!enqueue_write(std::move(*write))) {
+      return;
+    }
+  }
+  if (!write_in_progress && !_pending_writes.empty()) {
     do_async_write();
   }
 }
 
+auto Session::closed() const -> bool
+{
+  return _closed;
+}
+
+void Session::close()
+{
+  if (_closed.exchange(true)) {
+    return;
+  }
+  _deadline.cancel();
+  std::error_code ignored;
+  _socket.close(ignored);
+  _pending_writes.clear();
+  _queued_bytes = 0;
+  drop_read_handlers();
+  if (auto on_close{std::exchange(_on_close, nullptr)}) {
+    on_close();
+  }
+}
+
+void Session::drop_read_handlers()
+{
+  // One of them may be running, so they are dropped once it returns.
+  if (_delivering) {
+    return;
+  }
+  _pending_reads = {};
+  _outstanding_requests.clear();
+  _on_push = nullptr;
+}
+
 void Session::do_async_read()
 {
-  asio::async_read_until(
-      _socket,
-      // _streambuf,
-      asio::dynamic_buffer(_read_buf), '\n',
+  _read_in_progress = true;
+  auto const has_timeouts{_limits.idle_timeout.count() != 0 ||
+                          _limits.read_timeout.count() != 0};
+  if (has_timeouts && !std::exchange(_watching_deadline, true)) {
+    arm_deadline(true);
+    watch_deadline();
+  }
+
+  if (!_read_buf.empty()) {
+    read_some();
+    return;
+  }
+  Buffer_pool::instance().release(std::exchange(_read_buf, {}));
+  _socket.async_wait(
+      tcp::socket::wait_read,
+      recycling(_read_memory, [self{shared_from_this()}](std::error_code ec) {
+        if (read_failed(ec)) {
+          self->_read_in_progress = false;
+          self->close();
+          return;
+        }
+        self->_read_buf = Buffer_pool::instance().acquire(read_chunk_size);
+        self->read_some();
+      }));
+}
+
+void Session::read_some()
+{
+  auto const old_size{_read_buf.size()};
+  _read_buf.resize(old_size + read_chunk_size);
+  _socket.async_read_some(
+      asio::buffer(_read_buf.data() + old_size, read_chunk_size),
       // Captures self by value to extend session's lifetime
-      [self{shared_from_this()}](std::error_code ec, std::size_t length) {
-        if (ec == asio::error::eof) {
+      recycling(_read_memory, [self{shared_from_this()},
+                               old_size](std::error_code ec,
+                                         std::size_t length) {
+        self->_read_buf.resize(old_size + length);
+        self->_read_in_progress = false;
+        if (read_failed(ec)) {
+          self->close();
           return;
         }
-        if (ec) {
-          // Do not throw exception because client can construct a malformed
-          // package, or just not responding to us. Throwing exception can
-          // cause server stop.
-          spdlog::warn("Error occurred while reading from session: {}, closing "
-                       "this session.",
-                       ec.message());
+        spdlog::debug("Read bytes Length: {}", length);
+
+        auto const frame_completed{self->decode_frames()};
+        if (self->_closed) {
           return;
         }
+        if (self->_watching_deadline) {
+          self->arm_deadline(frame_completed);
+        }
+        self->deliver_read_packets();
+      }));
+}
 
-        // std::istream is{&self->_streambuf};
-        // std::stringstream ss;
-        // ss << is.rdbuf();
-        // spdlog::debug("The buffer now: {}", ss.str());
-        spdlog::debug("The buffer now: BUFFER_BEGIN\n{}\nBUFFER_END",
-                      self->_read_buf);
-        std::string buffer;
-        // std::getline(ss, buffer);
-        // TODO(shelpam): this is slow; improve this. Maybe use
-        // asio::streambuf.
-        buffer = self->_read_buf.substr(0, length - 1);
-        self->_read_buf = self->_read_buf.substr(length);
-        spdlog::debug("Read bytes: {}", buffer);
-        spdlog::debug("Read bytes Length: {}", length);
-        auto packet{json::parse(buffer).get<Packet>()};
-        spdlog::debug("Reading from socket: {}", packet);
+auto Session::decode_frames() -> bool
+{
+  using frame::Header;
 
-        // Same as above
-        try {
-          self->_pending_reads.front()(std::move(packet));
-          self->_pending_reads.pop();
-          if (!self->_pending_reads.empty()) {
-            self->do_async_read();
-          }
+  auto const decode_packet{[this](std::string_view body) {
+    spdlog::debug("Read bytes: {}", body);
+    try {
+      _read_packets.push_back(
+          Packet::parse(codec::decode(body, _encoding)));
+    }
+    catch (json::exception const &e) {
+      spdlog::warn("Dropping malformed packet: {}", e.what());
+    }
+  }};
+
+  std::size_t consumed{};
+  while (!_handshaking) {
+    std::string_view const rest{_read_buf.data() + consumed,
+                                _read_buf.size() - consumed};
+
+    if (_framing == frame::Framing::newline) {
+      auto const end{rest.find('\n', _scanned)};
+      if (end == std::string_view::npos) {
+        if (rest.size() > _limits.max_frame_size) {
+          reject_frame(rest.size());
+          return false;
         }
-        catch (std::runtime_error &re) {
-          spdlog::error("Error occurred: {}, closing this session.", re.what());
+        _scanned = rest.size();
+        break;
+      }
+      if (end > _limits.max_frame_size) {
+        reject_frame(end);
+        return false;
+      }
+      _scanned = 0;
+      consumed += end + 1;
+
+      auto const line{rest.substr(0, end)};
+      if (std::exchange(_first_frame, false) &&
+          line.starts_with(frame::handshake_prefix)) {
+        accept_handshake(*frame::parse_handshake(line));
+        continue;
+      }
+      decode_packet(line);
+      continue;
+    }
+
+    if (rest.size() < Header::size) {
+      break;
+    }
+    auto const header{frame::decode(rest.data())};
+    if (header.length > _limits.max_frame_size) {
+      reject_frame(header.length);
+      return false;
+    }
+    if (rest.size() < Header::size + header.length) {
+      break;
+    }
+    _first_frame = false;
+    consumed += Header::size + header.length;
+
+    if (header.type != frame::Type::packet) {
+      spdlog::warn("Unknown frame type {}, skipping it.",
+                   static_cast<int>(header.type));
+      continue;
+    }
+    decode_packet(rest.substr(Header::size, header.length));
+  }
+
+  // Only the incomplete frame, if any, is left and moved to the front.
+  _read_buf.erase(0, consumed);
+  return consumed != 0;
+}
+
+void Session::arm_deadline(bool frame_completed)
+{
+  auto const expire_after{[this](std::chrono::seconds timeout) {
+    if (timeout.count() == 0) {
+      _deadline.expires_at(asio::steady_timer::time_point::max());
+    }
+    else {
+      _deadline.expires_after(timeout);
+    }
+  }};
+
+  if (_read_buf.empty()) {
+    _receiving_frame = false;
+    expire_after(_limits.idle_timeout);
+  }
+  else if (frame_completed || !_receiving_frame) {
+    _receiving_frame = true;
+    expire_after(_limits.read_timeout);
+  }
+}
+
+void Session::watch_deadline()
+{
+  _deadline.async_wait(recycling(_deadline_memory, [self{shared_from_this()}](
+                                                     std::error_code /*ec*/) {
+    if (self->_closed) {
+      return;
+    }
+    // Pushing the deadline back aborts the wait, which is then restarted.
+    if (self->_deadline.expiry() > asio::steady_timer::clock_type::now()) {
+      self->watch_deadline();
+      return;
+    }
+    spdlog::info("Peer has {}, closing this session.",
+                 self->_receiving_frame ? "not finished sending a frame in time"
+                                        : "been idle for too long");
+    self->close();
+  }));
+}
+
+void Session::reject_frame(std::size_t size)
+{
+  spdlog::warn("Peer sent a frame of {} bytes, more than {} allowed, closing "
+               "this session.",
+               size, _limits.max_frame_size);
+  close();
+}
+
+void Session::accept_handshake(frame::Handshake handshake)
+{
+  _handshake_answer = frame::handshake_line(handshake);
+  spdlog::debug("Peer asked for handshake, answering {}", _handshake_answer);
+
+  // Stops decoding until the answer is sent, since the frames after the
+  // handshake are in the new framing. This is the first frame of the session,
+  // so nothing else can be writing.
+  _handshaking = true;
+  asio::async_write(
+      _socket, asio::buffer(_handshake_answer),
+      recycling(_write_memory, [self{shared_from_this()}, handshake](
+                                   std::error_code ec,
+                                   std::size_t /*length*/) {
+        if (ec) {
+          spdlog::warn("Error occurred: {}", ec.message());
+          self->close();
+          return;
         }
-      });
+        self->_framing = handshake.framing;
+        self->_encoding = handshake.encoding;
+        self->_handshaking = false;
+        self->decode_frames();
+        self->deliver_read_packets();
+      }));
+}
+
+void Session::deliver_read_packets()
+{
+  // Handlers may schedule reads themselves, which are served by this loop.
+  if (_delivering) {
+    return;
+  }
+  _delivering = true;
+
+  // Same as above
+  try {
+    while (_next_read_packet != _read_packets.size()) {
+      if (auto const &packet{_read_packets[_next_read_packet]};
+          is_outstanding_reply(packet)) {
+        auto const it{_outstanding_requests.find(packet.id)};
+        auto on_replied{std::move(it->second)};
+        _outstanding_requests.erase(it);
+        on_replied(take_read_packet());
+        continue;
+      }
+
+      if (_on_push) {
+        _on_push(take_read_packet());
+        continue;
+      }
+
+      if (_pending_reads.empty()) {
+        break;
+      }
+      auto read{std::move(_pending_reads.front())};
+      _pending_reads.pop();
+
+      if (read.on_read_batch) {
+        std::vector<Packet> batch;
+        do {
+          batch.push_back(take_read_packet());
+        } while (_next_read_packet != _read_packets.size() &&
+                 !is_outstanding_reply(_read_packets[_next_read_packet]));
+        spdlog::debug("Reading {} packets from socket", batch.size());
+        read.on_read_batch(std::move(batch));
+        continue;
+      }
+
+      auto packet{take_read_packet()};
+      spdlog::debug("Reading from socket: {}", packet);
+      read.on_read(std::move(packet));
+    }
+  }
+  catch (std::runtime_error &re) {
+    spdlog::error("Error occurred: {}, closing this session.", re.what());
+    _delivering = false;
+    close();
+    return;
+  }
+
+  _delivering = false;
+  if (_closed) {
+    drop_read_handlers();
+    return;
+  }
+
+  auto const should_read{!_pending_reads.empty() ||
+                         !_outstanding_requests.empty() || _on_push};
+  if (should_read && !_read_in_progress && !_handshaking && !_closed) {
+    do_async_read();
+  }
 }
 
 void Session::do_async_write()
 {
   spdlog::debug("PENDING WRITES QUEUE SIZE: {}", _pending_writes.size());
 
-  _write_buf = json(_pending_writes.front().packet).dump() + '\n';
+  static constexpr char newline{'\n'};
+
+  _writing.swap(_pending_writes);
+  _write_seq.clear();
+  for (auto const &write : _writing) {
+    _write_seq.emplace_back(asio::buffer(write.bytes));
+    if (write.packet.encoded_payload) {
+      _write_seq.emplace_back(asio::buffer(*write.packet.encoded_payload));
+      _write_seq.emplace_back(asio::buffer(write.tail));
+    }
+    if (_framing == frame::Framing::newline) {
+      _write_seq.emplace_back(asio::buffer(&newline, 1));
+    }
+  }
 
   spdlog::debug("Calling asio::async_write");
+  // A span, as the buffer sequence is copied into the operation.
   asio::async_write(
-      _socket, asio::buffer(_write_buf),
-      [self{shared_from_this()}](std::error_code ec, std::size_t length) {
-        spdlog::debug("Writing to socket: {}", self->_write_buf);
-        spdlog::debug("Written length: {}", length);
+      _socket, std::span<asio::const_buffer const>{_write_seq},
+      recycling(_write_memory, [self{shared_from_this()}](std::error_code ec,
+                                                          std::size_t length) {
+        spdlog::debug("Written {} packets, length: {}", self->_writing.size(),
+                      length);
 
         spdlog::debug("ec: {}", ec.message());
+        if (ec == asio::error::operation_aborted) {
+          return;
+        }
         if (ec == asio::error::eof) {
+          self->close();
           return;
         }
         if (ec) {
           spdlog::warn("Error occurred: {}", ec.message());
+          self->close();
           return;
         }
 
         try {
-          self->_pending_writes.front().post_write();
-          self->_pending_writes.pop();
+          for (auto &write : self->_writing) {
+            self->_queued_bytes -= write.size();
+            write.post_write();
+            Buffer_pool::instance().release(std::move(write.bytes));
+          }
+          self->_writing.clear();
           if (!self->_pending_writes.empty()) {
-            self->do_async_write(); // Try scheduling next unsent packet.
+            self->do_async_write(); // Try scheduling next unsent packets.
           }
         }
         catch (std::runtime_error &re) {
           spdlog::error("Error occurred: {}, closing this session.", re.what());
+          self->close();
         }
-      });
+      }));
+}
+
+auto Session::Write::size() const -> std::size_t
+{
+  return bytes.size() +
+         (packet.encoded_payload ? packet.encoded_payload->size() : 0) +
+         tail.size();
+}
+
+void Session::serialize(Write &write)
+{
+  auto &packet{write.packet};
+  auto &out{write.bytes};
+  // Not `capacity() == 0`, which a string never has, as short strings are
+  // kept in place.
+  if (out.capacity() < Buffer_pool::min_class_size) {
+    out = Buffer_pool::instance().acquire(Buffer_pool::min_class_size);
+  }
+  out.clear();
+
+  auto const length_prefixed{_framing == frame::Framing::length_prefixed};
+  if (length_prefixed) {
+    // Leaves room for the header, which is filled in once the length is known.
+    out.resize(frame::Header::size);
+  }
+
+  // Binary encodings are never used with newline framing.
+  std::string_view payload;
+  write.tail = {};
+  if (packet.encoded_payload == nullptr) {
+    auto j = std::move(packet).into_json();
+    codec::encode_to(j, _encoding, out);
+    // Moved back, so that the packet can be serialized again.
+    packet.payload = std::move(j["payload"]);
+  }
+  else if (!packet.sender) {
+    // The envelope of packets without sender, as server pushes and replies
+    // are, is written without building a json DOM.
+    payload = *packet.encoded_payload;
+    std::array const envelope{
+        codec::Member{"protocol", packet.protocol},
+        codec::Member{"id", packet.id},
+    };
+    write.tail = codec::encode_head_to(envelope, "payload", _encoding, out);
+  }
+  else {
+    payload = *packet.encoded_payload;
+    write.tail =
+        codec::encode_head_to(packet.envelope(), "payload", _encoding, out);
+  }
+
+  if (length_prefixed) {
+    auto const length{out.size() - frame::Header::size + payload.size() +
+                      write.tail.size()};
+    auto const header{frame::encode(frame::Header{
+        .length = static_cast<std::uint32_t>(length),
+        .type = frame::Type::packet})};
+    std::ranges::copy(header, out.begin());
+  }
+}
+
+auto negotiate_handshake(tcp::socket &socket,
+                         frame::Handshake wanted) -> frame::Handshake
+{
+  spdlog::trace("Call {}", std::source_location::current().function_name());
+
+  asio::write(socket, asio::buffer(frame::handshake_line(wanted)));
+
+  std::string answer;
+  auto const length{
+      asio::read_until(socket, asio::dynamic_buffer(answer), '\n')};
+  auto const agreed{
+      frame::parse_handshake(answer.substr(0, length - 1)).value_or(
+          frame::Handshake{})};
+  if (agreed.framing != wanted.framing || agreed.encoding != wanted.encoding) {
+    spdlog::warn("Server doesn't support the handshake we want, falling back "
+                 "to {}",
+                 frame::handshake_line(agreed));
+  }
+  return agreed;
 }
@@ -1,42 +1,258 @@
 #pragma once
 
+#include "frame.h"
+#include "handler-allocator.h"
+#include "lock-free-queue.h"
 #include "packet.h"
+#include "player-fwd.h"
 #include "session_fwd.h"
+#include "small-function.h"
 #include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <queue>
+#include <unordered_map>
 
 using asio::ip::tcp;
 
+// Who is on the other side of a session, once authenticated.
+struct Session_identity {
+  std::string username;
+  // Handle of the player of `username` on the server.
+  Player_handle player_handle;
+  // Version of the player last sent to the session by "login" or "sync".
+  std::uint64_t synced_version{};
+};
+
+// Bounds what a session queues for writing, so that a peer not keeping up
+// can't make us grow without limit, and how long it waits for the peer.
+// Sessions exceeding them are closed.
+struct Session_limits {
+  std::size_t max_queued_packets{1024};
+  std::size_t max_queued_bytes{std::size_t{4} << 20};
+  // Frames larger than this are rejected, and the session is closed, as the
+  // rest of the stream can't be trusted. Handshake lines count as frames.
+  std::size_t max_frame_size{std::size_t{1} << 20};
+  // How long the peer may send no packet at all. `0` means forever.
+  std::chrono::seconds idle_timeout{};
+  // How long the peer may take to send the rest of a frame once it has sent
+  // part of it. `0` means forever.
+  std::chrono::seconds read_timeout{};
+};
+
+// Lets a packet sent while an earlier one is still queued be folded into it,
+// instead of being queued too. This is tried on the queued packets with the
+// same key, as long as only packets with keys are queued after them, so that
+// packets are never reordered across one that can't be coalesced.
+struct Coalescing {
+  // `0` means the packet is never coalesced.
+  std::uint64_t key{};
+  // Folds `later` into `queued`, returning whether it could. Must be set if
+  // `key` is.
+  auto (*merge)(Packet &queued, Packet &later) -> bool {};
+};
+
 // There will be a worker keeping to check pending packets and to send them.
 // But if no pending packet exists, the worker stops working. And now there be a
 // reading worker same as sending worker.
+//
+// Every handler of a session runs on the executor of its socket, which is a
+// strand on the server. The public functions can be called from any thread,
+// and the handlers given to them are run on that executor.
 class Session : public std::enable_shared_from_this<Session> {
+public:
+  // Handlers are stored in place if they capture a few pointers only, so that
+  // queuing one doesn't allocate.
+  using Packet_handler = Small_function<void(Packet)>;
+  using Batch_handler = Small_function<void(std::vector<Packet>)>;
+  using Handler = Small_function<void()>;
+
+private:
+  // Exactly one of the handlers is set.
+  struct Read {
+    Packet_handler on_read;
+    Batch_handler on_read_batch;
+  };
+
   struct Write {
     Packet packet;
-    std::function<void()> post_write;
+    Handler post_write;
+    Coalescing coalescing{};
+    // The serialized packet, but the encoded payload, which is written from
+    // `packet` followed by `tail`.
+    std::string bytes{};
+    std::string_view tail{};
+
+    // Number of bytes written for the packet.
+    [[nodiscard]] auto size() const -> std::size_t;
   };
 
 public:
   Session() = delete;
-  Session(tcp::socket socket);
+  // `handshake` is what's already agreed on with the peer. Sessions accepted
+  // by the server start with the defaults, and switch when the client asks for
+  // something else in the handshake.
+  Session(tcp::socket socket, frame::Handshake handshake = {},
+          Session_limits limits = {});
+  Session(Session const &) = delete;
+  Session(Session &&) = delete;
+  auto operator=(Session const &) -> Session & = delete;
+  auto operator=(Session &&) -> Session & = delete;
+  // Gives the buffers back to the pool.
+  ~Session();
 
-  void schedule_request(Packet packet, std::function<void(Packet)> on_replied);
+  // Sends `packet` with a fresh request id. Many requests can be outstanding
+  // at the same time; each reply is handed to the `on_replied` of the request
+  // with the same id, whatever order the replies arrive in.
+  void schedule_request(Packet packet, Packet_handler on_replied);
 
   // When read, don't reply
-  void schedule_read(std::function<void(Packet)> on_read);
+  void schedule_read(Packet_handler on_read);
+
+  // Same as `schedule_read`, but `on_read` receives every packet that has been
+  // received by then (at least one) in a single call.
+  void schedule_read_batch(Batch_handler on_read);
+
+  // From now on, keeps reading and hands every packet that isn't a reply to a
+  // request to `on_push`, instead of to the pending reads.
+  void handle_pushes(Packet_handler on_push);
+
+  // Queues `packet` to be written, without waiting for the executor of the
+  // session. Unlike the other functions, this must only be called from a
+  // single thread (the simulation thread on the server).
+  void send(Packet packet, Coalescing coalescing = {});
+
+  // The identity bound to the session by logging in, or `nullptr` if the
+  // session isn't authenticated yet. These must only be called from a single
+  // thread (the simulation thread on the server).
+  [[nodiscard]] auto identity() const -> Session_identity const *;
+  [[nodiscard]] auto identity() -> Session_identity *;
+  void identity(std::optional<Session_identity> identity);
+
+  // The encoding agreed on by the handshake. The handshake is done before any
+  // packet is received, so this is safe to call once a packet is handed out.
+  [[nodiscard]] auto encoding() const -> codec::Encoding;
+
+  // Calls `handler` once the session is closed, whatever the cause: the peer
+  // closing the connection, an error, or a limit being exceeded. It is called
+  // on the executor of the session.
+  void on_close(Handler handler);
+  // Whether the session is closed. Safe to call from any thread.
+  [[nodiscard]] auto closed() const -> bool;
 
   // We guarantee there will be at most one instance of this function running.
-  void schedule_write(Packet packet, std::function<void()> post_write);
+  // Packets scheduled while a write is in progress are sent together by the
+  // next write.
+  void schedule_write(Packet packet, Handler post_write);
 
 private:
+  static constexpr std::size_t read_chunk_size{4096};
+
+  void push_read(Read read);
+  void push_write(Write write);
+  // Coalesces `write` or serializes it into the pending writes, closing the
+  // session if the limits are exceeded.
+  //
+  // @return
+  //  Whether the session is still open.
+  auto enqueue_write(Write write) -> bool;
+  // @return
+  //  Whether `write` is folded into a pending write.
+  auto coalesce(Write &write) -> bool;
+  // Moves packets sent by `send` to the pending writes.
+  void flush_outbox();
+  // Closes the socket, and drops everything queued. Handlers in progress are
+  // called with `asio::error::operation_aborted`. Closing twice does nothing.
+  void close();
+  // Drops the handlers waiting for packets, which may hold the session, so
+  // that a closed session is freed.
+  void drop_read_handlers();
+  [[nodiscard]] auto is_outstanding_reply(Packet const &packet) const -> bool;
+  [[nodiscard]] auto take_read_packet() -> Packet;
+  // Waits for the peer to send something if no frame is partially received,
+  // holding no buffer meanwhile, then reads it.
   void do_async_read();
+  void read_some();
 
+  // Decodes every complete frame in `_read_buf` into `_read_packets`. Closes
+  // the session if a frame is larger than the limit.
+  //
+  // @return
+  //  Whether any frame is consumed.
+  auto decode_frames() -> bool;
+  // Pushes the deadline back after reading, to the idle timeout if no frame
+  // is left partially received, or to the read timeout when a new frame
+  // starts. A frame trickling in doesn't push its deadline back.
+  void arm_deadline(bool frame_completed);
+  // Closes the session once `_deadline` passes. The wait is restarted each
+  // time the deadline is pushed back.
+  void watch_deadline();
+  void accept_handshake(frame::Handshake handshake);
+  void reject_frame(std::size_t size);
+  // Hands decoded packets to pending reads, then reads more if still needed.
+  void deliver_read_packets();
+
+  // Sends all pending writes with a single gather write.
   void do_async_write();
+  // Fills in `write.bytes` and `write.tail`. The packet is kept as is, so that
+  // it can be serialized again if another one is folded into it.
+  void serialize(Write &write);
 
   tcp::socket _socket;
-  std::queue<std::function<void(Packet)>> _pending_reads;
-  std::queue<Write> _pending_writes;
-  // asio::streambuf _streambuf;
+  frame::Framing _framing;
+  codec::Encoding _encoding;
+  // Only the first line of a session may be a handshake.
+  bool _first_frame{true};
+  bool _handshaking{};
+  bool _read_in_progress{};
+  bool _delivering{};
+  std::queue<Read> _pending_reads;
+  std::uint64_t _last_request_id{};
+  std::unordered_map<std::uint64_t, Packet_handler>
+      _outstanding_requests;
+  Packet_handler _on_push;
+  // Packets decoded but not claimed by any pending read yet, starting from
+  // `_next_read_packet`.
+  std::vector<Packet> _read_packets;
+  std::size_t _next_read_packet{};
+  Session_limits _limits;
+  // Written on the executor of the session, and read from any thread.
+  std::atomic<bool> _closed{};
+  Handler _on_close;
+  asio::steady_timer _deadline;
+  bool _watching_deadline{};
+  // Whether `_deadline` is the read timeout of a partially received frame.
+  bool _receiving_frame{};
+  // Handlers of the operations of each kind, which never overlap, reuse the
+  // same memory.
+  Handler_memory _read_memory;
+  // Gather writes keep up to 64 buffers of the sequence in the operation.
+  Handler_memory _write_memory{2048};
+  Handler_memory _deadline_memory;
+  std::vector<Write> _pending_writes;
+  // Writes being sent by the write in progress, if any.
+  std::vector<Write> _writing;
+  // Bytes of `_pending_writes` and `_writing`.
+  std::size_t _queued_bytes{};
+  std::vector<asio::const_buffer> _write_seq;
+  std::optional<Session_identity> _identity;
+  Spsc_queue<Write> _outbox;
+  std::atomic<bool> _outbox_flush_scheduled;
+  // Holds received bytes that are not consumed yet. It is taken from the pool
+  // when there is something to read, and given back once all is consumed.
   std::string _read_buf;
-  std::string _write_buf;
+  // Number of bytes at the front of `_read_buf` known to contain no '\n', so
+  // that a partial line is never scanned twice.
+  std::size_t _scanned{};
+  std::string _handshake_answer;
 };
+
+// Asks the server to use `wanted` for the connection. This blocks until the
+// server answers.
+//
+// @return
+//  What the server agreed on.
+[[nodiscard]] auto negotiate_handshake(tcp::socket &socket,
+                                       frame::Handshake wanted)
+    -> frame::Handshake;
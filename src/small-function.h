@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature, std::size_t Capacity = 48> class Small_function;
+
+// Move-only callable like `std::move_only_function`, but guaranteed to store
+// callables of up to `Capacity` bytes in place, so that queuing a handler
+// capturing a few pointers doesn't allocate. Larger ones are put on the heap.
+template <typename R, typename... Args, std::size_t Capacity>
+class Small_function<R(Args...), Capacity> {
+public:
+  Small_function() = default;
+  Small_function(std::nullptr_t) {}
+
+  template <typename F>
+    requires(!std::same_as<std::remove_cvref_t<F>, Small_function> &&
+             std::is_invocable_r_v<R, std::decay_t<F> &, Args...>)
+  Small_function(F &&f)
+  {
+    using Callable = std::decay_t<F>;
+    if constexpr (fits_in_place<Callable>) {
+      ::new (static_cast<void *>(_storage)) Callable(std::forward<F>(f));
+      _vtable = &in_place_vtable<Callable>;
+    }
+    else {
+      ::new (static_cast<void *>(_storage))
+          Callable *(new Callable(std::forward<F>(f)));
+      _vtable = &on_heap_vtable<Callable>;
+    }
+  }
+
+  Small_function(Small_function &&other) noexcept : _vtable{other._vtable}
+  {
+    if (_vtable != nullptr) {
+      _vtable->move(other._storage, _storage);
+      other._vtable = nullptr;
+    }
+  }
+
+  auto operator=(Small_function &&other) noexcept -> Small_function &
+  {
+    if (this != &other) {
+      reset();
+      _vtable = other._vtable;
+      if (_vtable != nullptr) {
+        _vtable->move(other._storage, _storage);
+        other._vtable = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  Small_function(Small_function const &) = delete;
+  auto operator=(Small_function const &) -> Small_function & = delete;
+
+  ~Small_function()
+  {
+    reset();
+  }
+
+  explicit operator bool() const
+  {
+    return _vtable != nullptr;
+  }
+
+  auto operator()(Args... args) -> R
+  {
+    return _vtable->invoke(_storage, std::forward<Args>(args)...);
+  }
+
+private:
+  struct Vtable {
+    auto (*invoke)(void *storage, Args &&...args) -> R;
+    // Moves the callable in `from` to `to`, and destroys the one in `from`.
+    void (*move)(void *from, void *to) noexcept;
+    void (*destroy)(void *storage) noexcept;
+  };
+
+  template <typename Callable>
+  static constexpr bool fits_in_place{
+      sizeof(Callable) <= Capacity &&
+      alignof(Callable) <= alignof(std::max_align_t) &&
+      std::is_nothrow_move_constructible_v<Callable>};
+
+  template <typename Callable>
+  static constexpr Vtable in_place_vtable{
+      .invoke = [](void *storage, Args &&...args) -> R {
+        return std::invoke(*static_cast<Callable *>(storage),
+                           std::forward<Args>(args)...);
+      },
+      .move =
+          [](void *from, void *to) noexcept {
+            auto &callable{*static_cast<Callable *>(from)};
+            ::new (to) Callable(std::move(callable));
+            callable.~Callable();
+          },
+      .destroy =
+          [](void *storage) noexcept {
+            static_cast<Callable *>(storage)->~Callable();
+          },
+  };
+
+  template <typename Callable>
+  static constexpr Vtable on_heap_vtable{
+      .invoke = [](void *storage, Args &&...args) -> R {
+        return std::invoke(**static_cast<Callable **>(storage),
+                           std::forward<Args>(args)...);
+      },
+      .move =
+          [](void *from, void *to) noexcept {
+            ::new (to) Callable *(*static_cast<Callable **>(from));
+          },
+      .destroy =
+          [](void *storage) noexcept {
+            delete *static_cast<Callable **>(storage);
+          },
+  };
+
+  void reset()
+  {
+    if (_vtable != nullptr) {
+      _vtable->destroy(_storage);
+      _vtable = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char _storage[Capacity];
+  Vtable const *_vtable{};
+};
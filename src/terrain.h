@@ -1,6 +1,7 @@
 #pragma once
 
 #include "json.h"
+#include "reflect.h"
 
 class Basic_terrain {
 public:
@@ -14,7 +15,7 @@ public:
 private:
   char _display;
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Basic_terrain, _display);
+  SB_DEFINE_TYPE_INTRUSIVE(Basic_terrain, _display);
 };
 
 namespace terrains {
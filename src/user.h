@@ -1,11 +1,18 @@
 #pragma once
 
 #include "json.h"
+#include "reflect.h"
+#include <cstddef>
 #include <string>
 #include <utility>
 
 class User_info {
 public:
+  // Longer names are rejected at login, so that names fit in datagrams.
+  static constexpr std::size_t max_username_size{32};
+
+  User_info() = default; // Conforms json.
+
   User_info(std::string username, std::string password)
       : _username{std::move(username)}, _password{std::move(password)}
   {
@@ -25,5 +32,5 @@ private:
   std::string _username;
   std::string _password;
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(User_info, _username, _password)
+  SB_DEFINE_TYPE_INTRUSIVE(User_info, _username, _password)
 };
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdlib>
+#include <spdlog/spdlog.h>
+#include <string_view>
+
+// Checks shared by the tests, which are plain programs run by `xmake test`. A
+// failed check is logged, and the test goes on so that every failure shows.
+namespace test {
+
+inline auto failed{false};
+
+inline void check(bool condition, std::string_view what)
+{
+  if (!condition) {
+    spdlog::error("Failed: {}", what);
+    failed = true;
+  }
+}
+
+// @return
+//  What `main` returns, failure if any check failed.
+[[nodiscard]] inline auto exit_status() -> int
+{
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+} // namespace test
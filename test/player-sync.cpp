@@ -0,0 +1,67 @@
+// Checks that every session bound to a player gets each change of it by
+// "sync", whichever of them syncs first, through the version kept in
+// `Session_identity` as the executor of "sync" does.
+//
+// Exits with failure if a session misses a change, or gets one twice.
+
+#include "check.h"
+#include "player.h"
+#include "session.h"
+
+namespace {
+
+using test::check;
+
+auto sync(Player const &player, Session_identity &identity) -> delta::Field_mask
+{
+  return player.take_fields_changed_since(identity.synced_version);
+}
+
+constexpr auto bit(Player::Field field) -> delta::Field_mask
+{
+  return delta::Field_mask{1} << std::to_underlying(field);
+}
+
+} // namespace
+
+auto main() -> int
+{
+  auto const player{Player::Builder{}
+                        .name("alice")
+                        .health(100)
+                        .damage_range({1, 2})
+                        .money(100)
+                        .build()};
+  constexpr delta::Field_mask all{(delta::Field_mask{1}
+                                   << Player::field_count) -
+                                  1};
+
+  Session_identity first{.username = "alice", .player_handle = {}};
+  Session_identity second{.username = "alice", .player_handle = {}};
+
+  check(sync(*player, first) == all, "a new player is sent whole");
+  player->take_damage(10);
+  check(sync(*player, first) == bit(Player::Field::health),
+        "the first session gets the change");
+  check(sync(*player, second) == all,
+        "the second session gets everything, though the first one synced");
+  check(sync(*player, second) == 0, "a change is sent once to a session");
+
+  player->cost_money(10);
+  check(sync(*player, second) == bit(Player::Field::money),
+        "the second session gets the change first");
+  player->heal(5);
+  check(sync(*player, first) ==
+            (bit(Player::Field::health) | bit(Player::Field::money)),
+        "the first session gets both changes since its last sync");
+  check(sync(*player, second) == bit(Player::Field::health),
+        "the second session gets only what it hasn't seen");
+
+  // Logging in sends the whole player, so later syncs start from there.
+  Session_identity third{.username = "alice",
+                         .player_handle = {},
+                         .synced_version = player->version()};
+  check(sync(*player, third) == 0, "a session logged in has seen everything");
+
+  return test::exit_status();
+}
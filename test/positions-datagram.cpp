@@ -0,0 +1,90 @@
+// Checks that datagrams of positions never exceed `datagram::max_size`, which
+// receivers would truncate, however long the names of the players seen are.
+//
+// Exits with failure if a datagram is too large, or can't be decoded back.
+
+#include "binary-codec.h"
+#include "check.h"
+#include "datagram.h"
+#include "player.h"
+#include "user.h"
+#include <memory>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using test::check;
+
+// `count` players at the same place, seeing each other, with names of
+// `name_size` bytes.
+auto crowd(std::size_t count, std::size_t name_size)
+    -> std::vector<std::unique_ptr<Player>>
+{
+  std::vector<std::unique_ptr<Player>> players;
+  for (std::size_t i{}; i != count; ++i) {
+    auto name{std::to_string(i)};
+    name.resize(name_size, 'x');
+    players.push_back(Player::Builder{}
+                          .name(std::move(name))
+                          .visual_range(100)
+                          .position(Vec2{1.0F, 1.0F})
+                          .build());
+  }
+  return players;
+}
+
+// Fills and encodes the datagram sent to the first of `players`, and checks it.
+//
+// @return
+//  The number of players in the datagram.
+auto send_positions(std::vector<std::unique_ptr<Player>> const &players,
+                    std::string_view what) -> std::size_t
+{
+  std::vector<Player const *> seen;
+  for (auto const &player : players) {
+    seen.push_back(player.get());
+  }
+  datagram::Positions positions;
+  datagram::fill_positions(positions, *players.front(),
+                           seen | std::views::transform(
+                                      [](auto const *player) -> auto const & {
+                                        return *player;
+                                      }));
+
+  auto const bytes{datagram::encode(
+      datagram::Header{.token = 1,
+                       .sequence = 1,
+                       .type = datagram::Type::positions},
+      positions)};
+  check(bytes.size() <= datagram::max_size, what);
+
+  binary_codec::Reader reader{bytes};
+  auto const header{datagram::read_header(reader)};
+  check(header && header->type == datagram::Type::positions, what);
+  datagram::Positions decoded;
+  reader.read(decoded);
+  check(decoded.players.size() == positions.players.size(), what);
+  check(!decoded.players.empty() &&
+            decoded.players.front().first == players.front()->name(),
+        what);
+  return decoded.players.size();
+}
+
+} // namespace
+
+auto main() -> int
+{
+  check(send_positions(crowd(100, 1), "short names") ==
+            datagram::max_positions,
+        "short names fill up to max_positions");
+  check(send_positions(crowd(100, User_info::max_username_size),
+                       "names of max_username_size") > 1,
+        "long names still leave room for others");
+  std::ignore =
+      send_positions(crowd(100, 500), "names longer than a login accepts");
+
+  return test::exit_status();
+}
@@ -9,7 +9,7 @@ set_languages("cxxlatest")
 
 add_rules("mode.debug", "mode.release")
 add_includedirs("src", "third-party/glad/include")
-add_requires("asio", "glfw", "nlohmann_json", "spdlog")
+add_requires("asio", "glfw", "nlohmann_json 3.11.x", "spdlog")
 add_requires("glm")
 add_requires("imgui", { configs = { glfw = true, opengl3 = true, } })
 mingw_special_settings()
@@ -31,3 +31,28 @@ target("little-sb-server")
     add_files("src/server/*.cpp")
     add_deps("lib")
     add_packages("asio", "glm", "nlohmann_json", "spdlog")
+
+-- Not built by default. Run with `xmake run bench-session-allocations`.
+target("bench-session-allocations")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/session-allocations.cpp")
+    add_deps("lib")
+    add_packages("asio", "glm", "nlohmann_json", "spdlog")
+
+-- Not built by default. Run with `xmake test`.
+target("test-player-sync")
+    set_kind("binary")
+    set_default(false)
+    add_files("test/player-sync.cpp")
+    add_deps("lib")
+    add_packages("asio", "glm", "nlohmann_json", "spdlog")
+    add_tests("default")
+
+target("test-positions-datagram")
+    set_kind("binary")
+    set_default(false)
+    add_files("test/positions-datagram.cpp")
+    add_deps("lib")
+    add_packages("asio", "glm", "nlohmann_json", "spdlog")
+    add_tests("default")